@@ -1,4 +1,3 @@
-#include <tuple>
 #include "../../include/impl/ChordVelocityMapping.h"
 
 namespace ChordVelocityMapping {
@@ -13,42 +12,30 @@ public:
     return Events::hasStart<noteData>(notes);
   }
 
-  virtual float computeMeanVelocity(std::vector<noteData> const& notes) {
-    if (notes.empty()) return 0;
-    uint8_t sum = 0;
-    for (auto& note : notes) {
-        sum += note.velocity;
-    }
-    return sum / notes.size();
-  }
+  // Statistics are computed here only when the chronology didn't precompute them.
 
-  virtual std::tuple<float, uint8_t, uint8_t>
-  computeVelocityStats(std::vector<noteData> const& notes) {
-    uint8_t cnt = 0, sum = 0, max = 0, min = 127;
-    for (auto& note : notes) {
-        if (note.on && note.velocity != 0) {
-            cnt++;
-            sum += note.velocity;
-            if (note.velocity > max) max = note.velocity;
-            if (note.velocity < min) min = note.velocity;
-        }
-    }
-    float mean = (cnt == 0) ? 0 : static_cast<float>(sum) / cnt;
-    return std::make_tuple(mean, min, max);
+  virtual void
+  adjustToCommandVelocity(std::vector<noteData>& notes,
+                          uint8_t cmd_velocity) {
+    adjustToCommandVelocity(notes, cmd_velocity, computeVelocityStats(notes));
   }
 
   virtual void
   adjustToCommandVelocity(std::vector<noteData>& notes,
-                          uint8_t cmd_velocity) = 0;
+                          uint8_t cmd_velocity,
+                          Events::SetStats<noteData> const& stats) = 0;
 };
 
 // STRATEGY IMPLEMENTATIONS ////////////////////////////////////////////////////
 
 class SameForAll :
 public ExtendedStrategy {
+  using ExtendedStrategy::adjustToCommandVelocity;
+
   virtual void
   adjustToCommandVelocity(std::vector<noteData>& notes,
-                          uint8_t cmd_velocity) {
+                          uint8_t cmd_velocity,
+                          Events::SetStats<noteData> const& stats) {
     for (auto& note : notes) {
       if (note.on && note.velocity != 0) {
         note.velocity = cmd_velocity;
@@ -59,10 +46,13 @@ public ExtendedStrategy {
 
 class ClippedScaledFromMean :
 public ExtendedStrategy {
+  using ExtendedStrategy::adjustToCommandVelocity;
+
   virtual void
   adjustToCommandVelocity(std::vector<noteData>& notes,
-                          uint8_t cmd_velocity) {
-    float mean = computeMeanVelocity(notes);
+                          uint8_t cmd_velocity,
+                          Events::SetStats<noteData> const& stats) {
+    float mean = stats.allMean; // Note offs included
     if (mean == 0.f) return;
 
     const int maxVelocity = 127, minVelocity = 1;
@@ -82,12 +72,14 @@ public ExtendedStrategy {
 
 class AdjustedScaledFromMean :
 public ExtendedStrategy {
+  using ExtendedStrategy::adjustToCommandVelocity;
+
   virtual void
   adjustToCommandVelocity(std::vector<noteData>& notes,
-                          uint8_t cmd_velocity) {
-    float mean;
-    uint8_t min, max;
-    std::tie(mean, min, max) = computeVelocityStats(notes);
+                          uint8_t cmd_velocity,
+                          Events::SetStats<noteData> const& stats) {
+    float mean = stats.mean;
+    uint8_t min = stats.min, max = stats.max;
     if (mean == 0.f) return;
 
     const uint8_t maxVelocity = 127, minVelocity = 1;
@@ -112,20 +104,19 @@ public ExtendedStrategy {
 
 class ClippedScaledFromMax :
 public ExtendedStrategy {
+  using ExtendedStrategy::adjustToCommandVelocity;
+
   virtual void
   adjustToCommandVelocity(std::vector<noteData>& notes,
-                          uint8_t cmd_velocity) {
-    uint8_t max = 0;
-    for (auto& note: notes) {
-      if (note.velocity > max) max = note.velocity;
-    }
+                          uint8_t cmd_velocity,
+                          Events::SetStats<noteData> const& stats) {
+    uint8_t max = stats.allMax; // Every note is scaled, note offs included
     if (max == 0) return;
 
     const int maxVelocity = 127, minVelocity = 1;
     float maxRatio = static_cast<float>(cmd_velocity) / max;
 
     for (auto& note: notes) {
-      float ratio = static_cast<float>(note.velocity) / max;
       int adjustedVelocity = note.velocity * maxRatio;
       note.velocity = uint8_t(
         std::min(maxVelocity, std::max(minVelocity, adjustedVelocity))
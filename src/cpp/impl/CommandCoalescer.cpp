@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "../../include/impl/CommandCoalescer.h"
+
+namespace {
+
+typedef Events::DenseKey<commandData> commandIndex;
+
+commandData releaseOf(commandData cmd, uint8_t velocity) {
+  cmd.pressed = false;
+  cmd.velocity = velocity;
+  return cmd;
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+// Definitions of the constants, needed before C++17 when they are ODR-used.
+
+constexpr std::size_t CommandCoalescer::MAX_GROUP_SIZE;
+constexpr std::size_t CommandCoalescer::KEY_COUNT;
+constexpr uint16_t CommandCoalescer::NO_LEADER;
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+CommandCoalescer::CommandCoalescer(MFPRenderer& r, outputCallback o,
+                                   int64_t w, bool u) :
+  renderer(r), output(o), window(w), useCommandVelocity(u) {
+  clear();
+}
+
+// PRIVATE METHODS /////////////////////////////////////////////////////////////
+
+void CommandCoalescer::play(commandData cmd) {
+  Events::Set<noteData> res = renderer.combine3Set(cmd, useCommandVelocity);
+  if (output && (!res.events.empty() || !res.side.events.empty())) output(res);
+}
+
+void CommandCoalescer::release(commandData cmd) {
+  std::size_t index = commandIndex::index(cmd);
+  uint16_t leader = leaders[index];
+
+  // Not played through a group (e.g. pressed before a clear) :
+  // the renderer knows what to do with it.
+
+  if (leader == NO_LEADER) {
+    play(cmd);
+    return;
+  }
+
+  leaders[index] = NO_LEADER;
+  if (--heldCounts[leader] == 0) play(releaseOf(leaderCommands[leader], cmd.velocity));
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+void CommandCoalescer::pushCommand(int64_t time, commandData cmd) {
+  poll(time);
+
+  if (!commandIndex::inRange(cmd)) {
+    Diagnostics::warning("command out of range dropped");
+    return;
+  }
+
+  std::size_t index = commandIndex::index(cmd);
+  bool staging = false;
+
+  for (std::size_t i = 0; i < stagedCount; i++)
+    staging = staging || commandIndex::index(staged[i]) == index;
+
+  if (!Events::isStart<commandData>(cmd)) {
+    if (staging) flush(); // Released before its deadline
+    release(cmd);
+    return;
+  }
+
+  // A press of a key still held ends its previous press,
+  // and a key pressed twice in a window starts a new step.
+
+  if (leaders[index] != NO_LEADER) release(releaseOf(cmd, 0));
+  if (staging) flush();
+
+  if (stagedCount == 0) deadline = time + window;
+  staged[stagedCount++] = cmd;
+
+  if (stagedCount == MAX_GROUP_SIZE || window <= 0) flush();
+}
+
+void CommandCoalescer::poll(int64_t time) {
+  if (stagedCount > 0 && time >= deadline) flush();
+}
+
+void CommandCoalescer::flush() {
+  if (stagedCount == 0) return;
+
+  commandData first = staged[0];
+  uint16_t leader = uint16_t(commandIndex::index(first));
+
+  // The renderer plays the ends bound to the first key with its new press
+  // (see Renderer::combine3Set) : the keys of its previous group
+  // no longer have anything to release.
+
+  if (heldCounts[leader] > 0) {
+    for (auto& l : leaders)
+      if (l == leader) l = NO_LEADER;
+  }
+
+  for (std::size_t i = 0; i < stagedCount; i++) {
+    first.velocity = std::max(first.velocity, staged[i].velocity);
+    leaders[commandIndex::index(staged[i])] = leader;
+  }
+
+  heldCounts[leader] = uint8_t(stagedCount);
+  leaderCommands[leader] = first;
+  stagedCount = 0;
+
+  play(first);
+}
+
+void CommandCoalescer::clear() {
+  stagedCount = 0;
+  deadline = 0;
+  leaders.fill(NO_LEADER);
+  heldCounts.fill(0);
+}
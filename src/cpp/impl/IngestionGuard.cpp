@@ -0,0 +1,108 @@
+#include <limits>
+#include "../../include/impl/IngestionGuard.h"
+
+namespace {
+
+typedef Events::DenseKey<commandData> commandIndex;
+
+// Far enough in the past for any debounce.
+
+const int64_t NEVER = std::numeric_limits<int64_t>::min() / 2;
+
+} /* END ANONYMOUS NAMESPACE */
+
+// Definitions of the constants, needed before C++17 when they are ODR-used
+// (default_params as a default argument).
+
+constexpr IngestionGuard::parameters IngestionGuard::default_params;
+constexpr std::size_t IngestionGuard::KEY_COUNT;
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+IngestionGuard::IngestionGuard(parameters p) : params(p), overloaded(false) {
+  clear();
+  resetCounters();
+}
+
+// PRIVATE METHODS /////////////////////////////////////////////////////////////
+
+// Give back the tokens of the whole intervals elapsed since the last refill.
+
+void IngestionGuard::refill(int64_t time) {
+  if (params.refillInterval <= 0 || time <= lastRefill) return;
+
+  int64_t intervals = (time - lastRefill) / params.refillInterval;
+  if (intervals == 0) return;
+
+  if (intervals >= int64_t(params.burst - tokens)) {
+    tokens = params.burst;
+    lastRefill = time;
+  } else {
+    tokens += uint32_t(intervals);
+    lastRefill += intervals * params.refillInterval;
+  }
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+bool IngestionGuard::admit(int64_t time, commandData const& cmd) {
+  if (!commandIndex::inRange(cmd)) {
+    count.outOfRange++;
+    return false;
+  }
+
+  std::size_t index = commandIndex::index(cmd);
+
+  if (!Events::isStart<commandData>(cmd)) {
+    if (!pressed[index]) {
+      count.orphanReleases++;
+      return false;
+    }
+
+    pressed[index] = false;
+    count.accepted++;
+    return true;
+  }
+
+  if (overloaded) {
+    count.shed++;
+    return false;
+  }
+
+  if (params.debounce > 0 && time - lastPresses[index] < params.debounce) {
+    count.debounced++;
+    return false;
+  }
+
+  if (params.refillInterval > 0) {
+    refill(time);
+
+    if (tokens == 0) {
+      count.rateLimited++;
+      return false;
+    }
+
+    tokens--;
+  }
+
+  lastPresses[index] = time;
+  pressed[index] = true;
+  count.accepted++;
+  return true;
+}
+
+void IngestionGuard::setParameters(parameters p) {
+  params = p;
+  if (tokens > params.burst) tokens = params.burst;
+}
+
+void IngestionGuard::resetCounters() {
+  count = { 0, 0, 0, 0, 0, 0 };
+}
+
+void IngestionGuard::clear() {
+  lastPresses.fill(NEVER);
+  pressed.fill(false);
+  tokens = params.burst;
+  lastRefill = NEVER;
+}
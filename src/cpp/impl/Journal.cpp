@@ -0,0 +1,367 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include "../../include/impl/Journal.h"
+
+namespace {
+
+const char JOURNAL_TAG[4] = { 'M', 'F', 'P', 'J' };
+const uint8_t JOURNAL_VERSION = 2;
+const std::size_t RECORD_SIZE = 16;
+const std::size_t SESSION_SIZE = 20;
+const uint32_t SEQUENCE_MASK = 0xFFFFFF; // Sequence numbers take 3 bytes
+
+// Sleep of the writer when the queue is empty : records wait at most this long
+// before they reach the file.
+
+const std::chrono::milliseconds WRITER_PERIOD(1);
+
+uint64_t steadyNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()
+  ).count();
+}
+
+void encode(Journal::record const& r, uint8_t* bytes) {
+  for (int i = 0; i < 8; i++) bytes[i] = uint8_t(r.time >> (8 * i));
+  bytes[8] = uint8_t(r.type);
+  std::memcpy(bytes + 9, r.data, sizeof(r.data));
+}
+
+void decode(const uint8_t* bytes, Journal::record& r) {
+  r.time = 0;
+  for (int i = 0; i < 8; i++) r.time |= uint64_t(bytes[i]) << (8 * i);
+  r.type = Journal::recordType(bytes[8]);
+  std::memcpy(r.data, bytes + 9, sizeof(r.data));
+}
+
+void encodeSequence(uint32_t sequence, uint8_t* bytes) {
+  for (int i = 0; i < 3; i++) bytes[i] = uint8_t(sequence >> (8 * i));
+}
+
+uint32_t decodeSequence(const uint8_t* bytes) {
+  return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16);
+}
+
+// The date of the parameters is left out, being unused.
+
+void encodeSession(Journal::session const& s, uint8_t* bytes) {
+  for (int i = 0; i < 8; i++) bytes[i] = uint8_t(s.partitionKey >> (8 * i));
+  bytes[8] = s.params.unmeet;
+  bytes[9] = s.params.complete;
+  bytes[10] = uint8_t(s.params.shiftMode);
+  for (int i = 0; i < 4; i++)
+    bytes[11 + i] = uint8_t(uint32_t(s.params.temporalResolution) >> (8 * i));
+  bytes[15] = uint8_t(s.params.clustering);
+  bytes[16] = s.params.precomputeStats;
+  bytes[17] = uint8_t(s.combineMode);
+  bytes[18] = uint8_t(s.voiceStealing) | (uint8_t(s.chordRendering) << 4);
+  bytes[19] = s.useCommandVelocity;
+}
+
+void decodeSession(const uint8_t* bytes, Journal::session& s) {
+  s.partitionKey = 0;
+  for (int i = 0; i < 8; i++) s.partitionKey |= uint64_t(bytes[i]) << (8 * i);
+  s.params = ChronologyParams::default_params;
+  s.params.unmeet = bytes[8] != 0;
+  s.params.complete = bytes[9] != 0;
+  s.params.shiftMode = Events::correspondOption(bytes[10]);
+  uint32_t resolution = 0;
+  for (int i = 0; i < 4; i++) resolution |= uint32_t(bytes[11 + i]) << (8 * i);
+  s.params.temporalResolution = int(resolution);
+  s.params.clustering = ChronologyParams::clusteringOption(bytes[15]);
+  s.params.precomputeStats = bytes[16] != 0;
+  s.combineMode = CombineMode(bytes[17]);
+  s.voiceStealing = VoiceStealing::StrategyType(bytes[18] & 0x0F);
+  s.chordRendering = ChordVelocityMapping::StrategyType(bytes[18] >> 4);
+  s.useCommandVelocity = bytes[19] != 0;
+}
+
+Journal::record makeRecord(uint64_t time, Journal::recordType type) {
+  Journal::record r;
+  r.time = time;
+  r.type = type;
+  std::memset(r.data, 0, sizeof(r.data));
+  return r;
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+Journal::Journal(std::string const& path, session const& s, std::size_t capacity) :
+  queue(new RingBuffer<record>(capacity)),
+  running(true),
+  droppedCount(0),
+  droppedTotal(0),
+  pushedCount(0),
+  writtenCount(0),
+  batchCount(0),
+  origin(steadyNanoseconds()) {
+  std::unique_ptr<std::ofstream> out(
+    new std::ofstream(path, std::ios::binary | std::ios::trunc)
+  );
+
+  if (!*out) return;
+
+  out->write(JOURNAL_TAG, sizeof(JOURNAL_TAG));
+  out->put(char(JOURNAL_VERSION));
+
+  uint8_t bytes[SESSION_SIZE];
+  encodeSession(s, bytes);
+  out->write(reinterpret_cast<const char*>(bytes), SESSION_SIZE);
+  out->flush();
+  file = std::move(out);
+
+  writer = std::thread([this]() { drain(); });
+}
+
+Journal::~Journal() {
+  running.store(false);
+  if (writer.joinable()) writer.join();
+}
+
+// PRIVATE METHODS /////////////////////////////////////////////////////////////
+
+uint64_t Journal::now() const {
+  return steadyNanoseconds() - origin;
+}
+
+void Journal::push(record const& r) {
+  if (!file) return;
+
+  // Tell how many records were lost before recording again.
+
+  if (droppedCount.load(std::memory_order_relaxed) > 0) {
+    uint32_t lost = droppedCount.exchange(0);
+
+    if (lost > 0) {
+      record d = makeRecord(r.time, recordType::DROPPED);
+      for (int i = 0; i < 4; i++) d.data[i] = uint8_t(lost >> (8 * i));
+
+      if (queue->push(d)) pushedCount.fetch_add(1, std::memory_order_relaxed);
+      else droppedCount.fetch_add(lost);
+    }
+  }
+
+  if (queue->push(r)) {
+    pushedCount.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    droppedCount.fetch_add(1, std::memory_order_relaxed);
+    droppedTotal.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Journal::drain() {
+  std::vector<uint8_t> bytes;
+  record r;
+
+  while (true) {
+    bool stopping = !running.load();
+    uint64_t count = 0;
+    bytes.clear();
+
+    while (queue->pop(r)) {
+      bytes.resize(bytes.size() + RECORD_SIZE);
+      encode(r, bytes.data() + bytes.size() - RECORD_SIZE);
+      count++;
+    }
+
+    if (count > 0) {
+      file->write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      file->flush();
+      writtenCount.fetch_add(count, std::memory_order_release);
+    } else if (stopping) {
+      break;
+    } else {
+      std::this_thread::sleep_for(WRITER_PERIOD);
+    }
+  }
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+void Journal::command(commandData const& cmd) {
+  record r = makeRecord(now(), recordType::COMMAND);
+  r.data[0] = cmd.pressed;
+  r.data[1] = cmd.id;
+  r.data[2] = cmd.velocity;
+  r.data[3] = cmd.channel;
+  push(r);
+}
+
+void Journal::output(std::vector<noteData> const& notes) {
+  static const std::vector<controlData> noControls;
+  output(notes, noControls);
+}
+
+void Journal::output(Events::Set<noteData> const& set) {
+  output(set.events, set.side.events);
+}
+
+void Journal::output(std::vector<noteData> const& notes,
+                     std::vector<controlData> const& controls) {
+  uint64_t time = now();
+  std::size_t count = notes.size() < 0xFFFF ? notes.size() : 0xFFFF;
+  std::size_t controlCount = controls.size() < 0xFFFF ? controls.size() : 0xFFFF;
+
+  // The notes may be pushed between the records of other threads, and some
+  // may be dropped : the sequence number tells which batch they belong to.
+
+  uint32_t sequence = batchCount.fetch_add(1, std::memory_order_relaxed) & SEQUENCE_MASK;
+
+  record r = makeRecord(time, recordType::OUTPUT);
+  r.data[0] = uint8_t(count);
+  r.data[1] = uint8_t(count >> 8);
+  encodeSequence(sequence, r.data + 2);
+  r.data[5] = uint8_t(controlCount);
+  r.data[6] = uint8_t(controlCount >> 8);
+  push(r);
+
+  // Controls come first, as they are played before the notes.
+
+  for (std::size_t i = 0; i < controlCount; i++) {
+    record c = makeRecord(time, recordType::CONTROL);
+    c.data[0] = controls[i].status;
+    c.data[1] = controls[i].data1;
+    c.data[2] = controls[i].data2;
+    encodeSequence(sequence, c.data + 4);
+    push(c);
+  }
+
+  for (std::size_t i = 0; i < count; i++) {
+    record n = makeRecord(time, recordType::NOTE);
+    n.data[0] = notes[i].on;
+    n.data[1] = notes[i].pitch;
+    n.data[2] = notes[i].velocity;
+    n.data[3] = notes[i].channel;
+    encodeSequence(sequence, n.data + 4);
+    push(n);
+  }
+}
+
+void Journal::flush() {
+  uint64_t pushed = pushedCount.load();
+  while (running.load() && writer.joinable()
+         && writtenCount.load(std::memory_order_acquire) < pushed)
+    std::this_thread::sleep_for(WRITER_PERIOD / 4);
+}
+
+// DECODING ////////////////////////////////////////////////////////////////////
+
+bool Journal::read(std::istream& in, session& s, std::vector<entry>& entries) {
+  char header[sizeof(JOURNAL_TAG) + 1];
+  if (!in.read(header, sizeof(header))) return false;
+  if (std::memcmp(header, JOURNAL_TAG, sizeof(JOURNAL_TAG)) != 0) return false;
+  if (uint8_t(header[sizeof(JOURNAL_TAG)]) != JOURNAL_VERSION) return false;
+
+  uint8_t sessionBytes[SESSION_SIZE];
+  if (!in.read(reinterpret_cast<char*>(sessionBytes), SESSION_SIZE)) return false;
+  decodeSession(sessionBytes, s);
+
+  // The OUTPUT entries whose notes or controls are still expected,
+  // by sequence number.
+
+  struct expectedBatch {
+    std::size_t entry;
+    std::size_t notes;
+    std::size_t controls;
+  };
+
+  std::unordered_map<uint32_t, expectedBatch> pending;
+
+  auto completes = [&entries](expectedBatch const& b) {
+    entry const& e = entries[b.entry];
+    return e.notes.size() == b.notes && e.controls.size() == b.controls;
+  };
+
+  uint8_t bytes[RECORD_SIZE];
+  record r;
+
+  while (in.read(reinterpret_cast<char*>(bytes), RECORD_SIZE)) {
+    decode(bytes, r);
+
+    switch (r.type) {
+      case recordType::COMMAND:
+        entries.push_back({ r.time, r.type, {
+          r.data[0] != 0, r.data[1], r.data[2], r.data[3]
+        }, {}, {}, true, 0 });
+        break;
+      case recordType::OUTPUT: {
+        expectedBatch batch = {
+          entries.size(),
+          r.data[0] | (std::size_t(r.data[1]) << 8),
+          r.data[5] | (std::size_t(r.data[6]) << 8)
+        };
+        entries.push_back({ r.time, r.type, {}, {}, {}, false, 0 });
+        if (completes(batch)) entries.back().complete = true;
+        else pending[decodeSequence(r.data + 2)] = batch;
+        break;
+      }
+      case recordType::NOTE:
+      case recordType::CONTROL: {
+        // Notes and controls whose OUTPUT record was dropped are skipped.
+        auto it = pending.find(decodeSequence(r.data + 4));
+        if (it == pending.end()) break;
+        entry& e = entries[it->second.entry];
+        if (r.type == recordType::NOTE)
+          e.notes.push_back({ r.data[0] != 0, r.data[1], r.data[2], r.data[3] });
+        else
+          e.controls.push_back({ r.data[0], r.data[1], r.data[2] });
+        if (completes(it->second)) {
+          e.complete = true;
+          pending.erase(it);
+        }
+        break;
+      }
+      case recordType::DROPPED:
+        entries.push_back({ r.time, r.type, {}, {}, {}, true,
+          uint32_t(r.data[0]) | (uint32_t(r.data[1]) << 8)
+          | (uint32_t(r.data[2]) << 16) | (uint32_t(r.data[3]) << 24)
+        });
+        break;
+      default:
+        return false;
+    }
+  }
+
+  // Batches still pending have lost records, to a full queue or to a crash :
+  // they are left incomplete.
+
+  return true;
+}
+
+void Journal::configure(MFPRenderer& renderer, session const& s) {
+  renderer.setCombineMode(s.combineMode);
+  renderer.setVoiceStealingStrategy(s.voiceStealing);
+  renderer.setChordRenderingStrategy(s.chordRendering);
+}
+
+std::vector<Replay::timedCommand> Journal::commands(std::vector<entry> const& entries) {
+  std::vector<Replay::timedCommand> res;
+  uint64_t last = 0;
+
+  for (auto& e : entries) {
+    if (e.type != recordType::COMMAND) continue;
+    res.push_back({ int64_t(e.time - last), e.cmd });
+    last = e.time;
+  }
+
+  return res;
+}
+
+bool Journal::outputs(std::vector<entry> const& entries, Replay::performance& res) {
+  bool complete = true;
+
+  for (auto& e : entries) {
+    if (e.type == recordType::OUTPUT) {
+      res.push_back(e.notes);
+      complete = complete && e.complete;
+    } else if (e.type == recordType::DROPPED) {
+      complete = false;
+    }
+  }
+
+  return complete;
+}
@@ -0,0 +1,152 @@
+#include <cmath>
+#include "../../include/impl/MidiFileWriter.h"
+
+namespace {
+
+const uint8_t NOTE_OFF = 0x80;
+const uint8_t NOTE_ON = 0x90;
+
+void putBigEndian(std::ostream& out, uint32_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) out.put(char((value >> (8 * i)) & 0xFF));
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+MidiFileWriter::MidiFileWriter(std::ostream& o, uint16_t d, uint32_t t) :
+  out(o), division(d), tempo(t), trackLength(0),
+  lastTick(0), runningStatus(0), closed(false), failed(false) {
+
+  buffer.reserve(BUFFER_SIZE);
+
+  // Header chunk : format 0, a single track.
+
+  out.write("MThd", 4);
+  putBigEndian(out, 6, 4);
+  putBigEndian(out, 0, 2);
+  putBigEndian(out, 1, 2);
+  putBigEndian(out, division, 2);
+
+  // Track chunk, its length to be written by close().
+
+  out.write("MTrk", 4);
+  trackLengthPos = out.tellp(); // -1 if the stream isn't seekable
+  putBigEndian(out, 0, 4);
+  if (!out || trackLengthPos == std::streampos(-1)) failed = true;
+
+  const uint8_t setTempo[] = {
+    0xFF, 0x51, 0x03,
+    uint8_t(tempo >> 16), uint8_t(tempo >> 8), uint8_t(tempo)
+  };
+  putEvent(0, setTempo, sizeof(setTempo));
+}
+
+MidiFileWriter::~MidiFileWriter() {
+  if (!closed) close();
+}
+
+// PRIVATE METHODS /////////////////////////////////////////////////////////////
+
+void MidiFileWriter::put(uint8_t byte) {
+  if (buffer.size() == BUFFER_SIZE) flush();
+  buffer.push_back(byte);
+  trackLength++;
+}
+
+void MidiFileWriter::putVariableLength(uint32_t value) {
+  uint8_t bytes[5];
+  int count = 0;
+
+  do {
+    bytes[count++] = value & 0x7F;
+    value >>= 7;
+  } while (value != 0);
+
+  // Most significant group first, all but the last one flagged.
+
+  while (count > 1) put(bytes[--count] | 0x80);
+  put(bytes[0]);
+}
+
+void MidiFileWriter::putEvent(int64_t tick, const uint8_t* bytes, std::size_t size) {
+  if (tick < lastTick) tick = lastTick;
+  putVariableLength(uint32_t(tick - lastTick));
+  lastTick = tick;
+
+  // Meta and system events cancel running status.
+
+  std::size_t first = 0;
+  if (bytes[0] >= 0xF0) runningStatus = 0;
+  else if (bytes[0] == runningStatus) first = 1;
+  else runningStatus = bytes[0];
+
+  for (std::size_t i = first; i < size; i++) put(bytes[i]);
+}
+
+void MidiFileWriter::flush() {
+  out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  buffer.clear();
+  if (!out) failed = true;
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+void MidiFileWriter::write(int64_t time, std::vector<noteData> const& notes) {
+  if (closed) return;
+
+  int64_t tick = time * 1000 * division / tempo;
+
+  for (auto& note : notes) {
+    uint8_t status = (note.on ? NOTE_ON : NOTE_OFF) | (note.channel & 0x0F);
+    const uint8_t event[] = { status, uint8_t(note.pitch & 0x7F), uint8_t(note.velocity & 0x7F) };
+    putEvent(tick, event, sizeof(event));
+  }
+}
+
+void MidiFileWriter::write(int64_t time, Events::Set<noteData> const& set,
+                           std::chrono::duration<double, std::milli> tickDuration) {
+  if (closed) return;
+
+  // Controls come first, as they preceded the notes in the partition.
+
+  int64_t tick = time * 1000 * division / tempo;
+
+  for (auto& control : set.side.events) {
+    uint8_t type = control.status & 0xF0;
+    const uint8_t event[] = { control.status, uint8_t(control.data1 & 0x7F), uint8_t(control.data2 & 0x7F) };
+    putEvent(tick, event, (type == 0xC0 || type == 0xD0) ? 2 : 3);
+  }
+
+  std::vector<noteData> note(1);
+
+  for (std::size_t i = 0; i < set.events.size(); i++) {
+    note[0] = set.events[i];
+    int64_t offset = std::llround(Events::offsetOf(set, i) * tickDuration.count());
+    write(time + offset, note);
+  }
+}
+
+bool MidiFileWriter::close() {
+  if (closed) return !failed;
+
+  const uint8_t endOfTrack[] = { 0xFF, 0x2F, 0x00 };
+  putEvent(lastTick, endOfTrack, sizeof(endOfTrack));
+  flush();
+  closed = true;
+  if (failed) return false;
+
+  std::streampos end = out.tellp();
+  out.seekp(trackLengthPos);
+  if (!out) {
+    failed = true;
+    return false;
+  }
+
+  putBigEndian(out, trackLength, 4);
+  out.seekp(end);
+  out.flush();
+  if (!out) failed = true;
+
+  return !failed;
+}
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "../../include/impl/PartitionCache.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char FILE_TAG[4] = { 'M', 'F', 'P', 'P' };
+const uint8_t FILE_VERSION = 2;
+const char* FILE_EXTENSION = ".mfpp";
+const char* TEMPORARY_TAG = ".mfpp.tmp"; // Followed by a unique suffix
+
+// A temporary not written to for that long was left by a crash.
+
+const auto STALE_TEMPORARY_AGE = std::chrono::minutes(10);
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+std::atomic<uint32_t> temporaryCount(0); // Makes temporary names unique
+
+uint64_t checksum(const uint8_t* bytes, std::size_t size) {
+  uint64_t h = FNV_OFFSET;
+  for (std::size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+// BYTE UTILITIES //////////////////////////////////////////////////////////////
+
+void putFixed(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+void putVariableLength(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(uint8_t(value));
+}
+
+// Offsets may be negative (shifted endings) : zigzag encoding keeps them short.
+
+void putSigned(std::vector<uint8_t>& out, int64_t value) {
+  putVariableLength(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+struct reader {
+  std::vector<uint8_t> const& bytes;
+  std::size_t pos;
+
+  bool fixed(uint64_t& value, int count) {
+    if (pos + count > bytes.size()) return false;
+    value = 0;
+    for (int i = 0; i < count; i++) value |= uint64_t(bytes[pos++]) << (8 * i);
+    return true;
+  }
+
+  bool variableLength(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos >= bytes.size()) return false;
+      uint8_t byte = bytes[pos++];
+      value |= uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+
+  bool signedValue(int64_t& value) {
+    uint64_t raw;
+    if (!variableLength(raw)) return false;
+    value = int64_t(raw >> 1) ^ -int64_t(raw & 1);
+    return true;
+  }
+};
+
+// FILE FORMAT /////////////////////////////////////////////////////////////////
+
+// Tag, version, key, set count, then for each set : dt, event count,
+// events (on, pitch, velocity, channel), offset count and offsets,
+// side event count and side events (status and two data bytes).
+// The checksum of all the preceding bytes comes last.
+// Statistics are not stored : they are computed again at load.
+
+std::vector<uint8_t> encode(PartitionCache::key k, Chronology<noteData> const& partition) {
+  std::vector<uint8_t> out(FILE_TAG, FILE_TAG + sizeof(FILE_TAG));
+  out.push_back(FILE_VERSION);
+  putFixed(out, k, 8);
+  putVariableLength(out, partition.size());
+
+  for (auto& set : partition) {
+    putSigned(out, set.dt);
+    putVariableLength(out, set.events.size());
+    for (auto& note : set.events) {
+      out.push_back(note.on);
+      out.push_back(note.pitch);
+      out.push_back(note.velocity);
+      out.push_back(note.channel);
+    }
+    putVariableLength(out, set.offsets.size());
+    for (auto offset : set.offsets) putSigned(out, offset);
+    putVariableLength(out, set.side.events.size());
+    for (auto& control : set.side.events) {
+      out.push_back(control.status);
+      out.push_back(control.data1);
+      out.push_back(control.data2);
+    }
+  }
+
+  putFixed(out, checksum(out.data(), out.size()), 8);
+  return out;
+}
+
+bool decode(std::vector<uint8_t> const& bytes, PartitionCache::key k,
+            ChronologyParams::parameters params, Chronology<noteData>& partition) {
+  if (bytes.size() < sizeof(FILE_TAG) + 1 + 8 + 8) return false;
+  if (std::memcmp(bytes.data(), FILE_TAG, sizeof(FILE_TAG)) != 0) return false;
+  if (bytes[sizeof(FILE_TAG)] != FILE_VERSION) return false;
+
+  std::size_t end = bytes.size() - 8;
+  reader in = { bytes, end };
+  uint64_t sum, storedKey, setCount;
+  if (!in.fixed(sum, 8) || sum != checksum(bytes.data(), end)) return false;
+
+  in.pos = sizeof(FILE_TAG) + 1;
+  if (!in.fixed(storedKey, 8) || storedKey != k) return false;
+  if (!in.variableLength(setCount)) return false;
+
+  Chronology<noteData> res(params);
+
+  for (uint64_t s = 0; s < setCount; s++) {
+    Events::Set<noteData> set = { 0, {}, {}, {}, {} };
+    uint64_t eventCount, offsetCount, sideCount;
+
+    if (!in.signedValue(set.dt) || !in.variableLength(eventCount)) return false;
+    if (in.pos > end || eventCount > (end - in.pos) / 4) return false;
+
+    set.events.reserve(eventCount);
+    for (uint64_t e = 0; e < eventCount; e++, in.pos += 4) {
+      set.events.push_back({
+        bytes[in.pos] != 0, bytes[in.pos + 1], bytes[in.pos + 2], bytes[in.pos + 3]
+      });
+      if (!Events::DenseKey<noteData>::inRange(set.events.back())) return false;
+    }
+
+    if (!in.variableLength(offsetCount)) return false;
+    if (offsetCount != 0 && offsetCount != eventCount) return false;
+
+    set.offsets.resize(offsetCount);
+    for (auto& offset : set.offsets)
+      if (!in.signedValue(offset)) return false;
+
+    if (!in.variableLength(sideCount)) return false;
+    if (in.pos > end || sideCount > (end - in.pos) / 3) return false;
+
+    set.side.events.reserve(sideCount);
+    for (uint64_t e = 0; e < sideCount; e++, in.pos += 3)
+      set.side.events.push_back({ bytes[in.pos], bytes[in.pos + 1], bytes[in.pos + 2] });
+
+    if (params.precomputeStats && Events::hasStart<noteData>(set))
+      Events::computeStats<noteData>(set);
+
+    res.pushFinalizedSet(set);
+  }
+
+  if (in.pos != end) return false;
+
+  partition = std::move(res);
+  return true;
+}
+
+bool isTemporary(fs::path const& path) {
+  return path.filename().string().find(TEMPORARY_TAG) != std::string::npos;
+}
+
+// Write the bytes and flush them to the disk, so that the file is complete
+// once renamed, even after a power loss. Elsewhere than on POSIX systems,
+// they are only flushed to the operating system.
+
+bool writeFile(fs::path const& path, std::vector<uint8_t> const& bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+
+  std::size_t written = 0;
+  while (written < bytes.size()) {
+    ssize_t count = ::write(fd, bytes.data() + written, bytes.size() - written);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) break;
+    written += std::size_t(count);
+  }
+
+  bool complete = written == bytes.size() && ::fsync(fd) == 0;
+  return ::close(fd) == 0 && complete;
+#else
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+  out.flush();
+  return bool(out);
+#endif
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+// KEY BUILDER /////////////////////////////////////////////////////////////////
+
+PartitionCache::keyBuilder::keyBuilder(ChronologyParams::parameters params) :
+  h(FNV_OFFSET) {
+  add(FILE_VERSION, 1);
+  add(params.unmeet, 1);
+  add(params.complete, 1);
+  add(uint64_t(params.shiftMode), 1);
+  add(uint64_t(int64_t(params.temporalResolution)), 8);
+  add(uint64_t(params.clustering), 1);
+  add(params.precomputeStats, 1);
+}
+
+void PartitionCache::keyBuilder::add(uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    h ^= uint8_t(value >> (8 * i));
+    h *= FNV_PRIME;
+  }
+}
+
+void PartitionCache::keyBuilder::add(int64_t dt, noteData const& note) {
+  add(uint64_t(dt), 8);
+  add(note.on, 1);
+  add(note.pitch, 1);
+  add(note.velocity, 1);
+  add(note.channel, 1);
+}
+
+// Controls are told apart from notes by a leading byte no note can give.
+
+void PartitionCache::keyBuilder::add(int64_t dt, controlData const& control) {
+  add(uint64_t(dt), 8);
+  add(0xFF, 1);
+  add(control.status, 1);
+  add(control.data1, 1);
+  add(control.data2, 1);
+}
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+PartitionCache::PartitionCache(fs::path d, std::uintmax_t m) :
+  directory(d), maxBytes(m) {
+  std::error_code error;
+  fs::create_directories(directory, error);
+  sweepTemporaries();
+}
+
+// PRIVATE METHODS /////////////////////////////////////////////////////////////
+
+fs::path PartitionCache::pathOf(key k) const {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)k);
+  return directory / (std::string(name) + FILE_EXTENSION);
+}
+
+void PartitionCache::evict() {
+  struct entry {
+    fs::path path;
+    fs::file_time_type used;
+    std::uintmax_t size;
+  };
+
+  std::vector<entry> entries;
+  std::uintmax_t total = 0;
+  std::error_code error;
+
+  // The temporaries being written count, but are left to their store.
+
+  for (auto& file : fs::directory_iterator(directory, error)) {
+    bool temporary = isTemporary(file.path());
+    if (!temporary && file.path().extension() != FILE_EXTENSION) continue;
+    entry e = { file.path(), file.last_write_time(error), file.file_size(error) };
+    if (error) continue;
+    total += e.size;
+    if (!temporary) entries.push_back(e);
+  }
+
+  if (total <= maxBytes) return;
+
+  std::sort(entries.begin(), entries.end(),
+    [](entry const& e1, entry const& e2) { return e1.used < e2.used; });
+
+  for (auto& e : entries) {
+    if (total <= maxBytes) break;
+    if (fs::remove(e.path, error)) total -= e.size;
+  }
+}
+
+void PartitionCache::sweepTemporaries() {
+  std::error_code error;
+  std::vector<fs::path> stale;
+  auto limit = fs::file_time_type::clock::now() - STALE_TEMPORARY_AGE;
+
+  for (auto& file : fs::directory_iterator(directory, error)) {
+    if (!isTemporary(file.path())) continue;
+    fs::file_time_type written = file.last_write_time(error);
+    if (!error && written < limit) stale.push_back(file.path());
+  }
+
+  for (auto& file : stale) fs::remove(file, error);
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+bool PartitionCache::load(key k, ChronologyParams::parameters params,
+                          Chronology<noteData>& partition) {
+  fs::path path = pathOf(k);
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+
+  std::vector<uint8_t> bytes(
+    (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()
+  );
+  in.close();
+
+  std::error_code error;
+
+  if (!decode(bytes, k, params, partition)) {
+    fs::remove(path, error); // Corrupted or from another version
+    return false;
+  }
+
+  // The modification time orders the partitions for eviction.
+
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+bool PartitionCache::store(key k, Chronology<noteData> const& partition) {
+  std::vector<uint8_t> bytes = encode(k, partition);
+
+  fs::path path = pathOf(k);
+  fs::path temporary = path;
+  temporary += ".tmp" + std::to_string(temporaryCount++) + "-"
+             + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+  std::error_code error;
+
+  if (!writeFile(temporary, bytes)) {
+    fs::remove(temporary, error);
+    return false;
+  }
+
+  fs::rename(temporary, path, error);
+  if (error) {
+    fs::remove(temporary, error);
+    return false;
+  }
+
+  evict();
+  return true;
+}
+
+std::uintmax_t PartitionCache::size() const {
+  std::uintmax_t total = 0;
+  std::error_code error;
+
+  for (auto& file : fs::directory_iterator(directory, error)) {
+    if (!isTemporary(file.path()) && file.path().extension() != FILE_EXTENSION) continue;
+    std::uintmax_t size = file.file_size(error);
+    if (!error) total += size;
+  }
+
+  return total;
+}
+
+void PartitionCache::clear() {
+  std::error_code error;
+  std::vector<fs::path> files;
+
+  for (auto& file : fs::directory_iterator(directory, error))
+    if (file.path().extension() == FILE_EXTENSION) files.push_back(file.path());
+
+  for (auto& file : files) fs::remove(file, error);
+}
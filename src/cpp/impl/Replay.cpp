@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstring>
+#include "../../include/impl/Replay.h"
+
+namespace Replay {
+
+namespace {
+
+const char LOG_TAG[4] = { 'M', 'F', 'P', 'C' };
+const uint8_t LOG_VERSION = 1;
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// BYTE UTILITIES //////////////////////////////////////////////////////////////
+
+void putVariableLength(std::ostream& out, uint64_t value) {
+  uint8_t bytes[10];
+  int count = 0;
+
+  do {
+    bytes[count++] = value & 0x7F;
+    value >>= 7;
+  } while (value != 0);
+
+  while (count > 1) out.put(char(bytes[--count] | 0x80));
+  out.put(char(bytes[0]));
+}
+
+bool getByte(std::istream& in, uint8_t& byte) {
+  char c;
+  if (!in.get(c)) return false;
+  byte = uint8_t(c);
+  return true;
+}
+
+bool getVariableLength(std::istream& in, uint64_t& value) {
+  uint8_t byte;
+  value = 0;
+
+  for (int i = 0; i < 10; i++) {
+    if (!getByte(in, byte)) return false;
+    value = (value << 7) | (byte & 0x7F);
+    if (!(byte & 0x80)) return true;
+  }
+
+  return false;
+}
+
+bool getBigEndian(std::istream& in, uint32_t& value, int bytes) {
+  uint8_t byte;
+  value = 0;
+
+  for (int i = 0; i < bytes; i++) {
+    if (!getByte(in, byte)) return false;
+    value = (value << 8) | byte;
+  }
+
+  return true;
+}
+
+// Same as the above, reading from the bytes of a track.
+
+bool getVariableLength(std::vector<uint8_t> const& bytes, std::size_t& pos, uint64_t& value) {
+  value = 0;
+
+  for (int i = 0; i < 4; i++) {
+    if (pos >= bytes.size()) return false;
+    uint8_t byte = bytes[pos++];
+    value = (value << 7) | (byte & 0x7F);
+    if (!(byte & 0x80)) return true;
+  }
+
+  return false;
+}
+
+// HASHING /////////////////////////////////////////////////////////////////////
+
+void hashByte(uint64_t& h, uint8_t byte) {
+  h ^= byte;
+  h *= FNV_PRIME;
+}
+
+// The size of each result is hashed first,
+// so that moving a note to the next result changes the hash.
+
+void hashResult(uint64_t& h, std::vector<noteData> const& notes) {
+  uint32_t size = uint32_t(notes.size());
+  for (int i = 0; i < 4; i++) hashByte(h, uint8_t(size >> (8 * i)));
+
+  for (auto& note : notes) {
+    hashByte(h, note.on);
+    hashByte(h, note.pitch);
+    hashByte(h, note.velocity);
+    hashByte(h, note.channel);
+  }
+}
+
+bool sameResult(std::vector<noteData> const& r1, std::vector<noteData> const& r2) {
+  return r1.size() == r2.size() && std::equal(r1.begin(), r1.end(), r2.begin());
+}
+
+// MIDI FILE TRACKS ////////////////////////////////////////////////////////////
+
+struct trackEvent {
+  uint64_t time; // absolute, in ticks
+  commandData cmd;
+};
+
+bool readTrack(std::vector<uint8_t> const& bytes, std::vector<trackEvent>& events) {
+  std::size_t pos = 0;
+  uint64_t time = 0;
+  uint8_t status = 0;
+
+  while (pos < bytes.size()) {
+    uint64_t dt;
+    if (!getVariableLength(bytes, pos, dt)) return false;
+    time += dt;
+
+    if (pos >= bytes.size()) return false;
+
+    if (bytes[pos] & 0x80) status = bytes[pos++];
+    else if (status == 0) return false; // running status without a previous status
+
+    if (status == 0xFF) { // meta event
+      if (pos >= bytes.size()) return false;
+      uint8_t type = bytes[pos++];
+      uint64_t length;
+      if (!getVariableLength(bytes, pos, length)) return false;
+      pos += length;
+      status = 0;
+      if (type == 0x2F) break; // end of track
+      continue;
+    }
+
+    if (status == 0xF0 || status == 0xF7) { // system exclusive
+      uint64_t length;
+      if (!getVariableLength(bytes, pos, length)) return false;
+      pos += length;
+      status = 0;
+      continue;
+    }
+
+    uint8_t type = status & 0xF0;
+    std::size_t dataLength = (type == 0xC0 || type == 0xD0) ? 1 : 2;
+    if (pos + dataLength > bytes.size()) return false;
+
+    if (type == 0x80 || type == 0x90) {
+      uint8_t pitch = bytes[pos], velocity = bytes[pos + 1];
+      bool pressed = type == 0x90 && velocity != 0;
+      events.push_back({ time, { pressed, pitch, velocity, uint8_t(status & 0x0F) } });
+    }
+
+    pos += dataLength;
+  }
+
+  return pos <= bytes.size();
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+// COMMAND SOURCES /////////////////////////////////////////////////////////////
+
+void writeCommandLog(std::ostream& out, std::vector<timedCommand> const& commands) {
+  out.write(LOG_TAG, sizeof(LOG_TAG));
+  out.put(char(LOG_VERSION));
+
+  for (auto& command : commands) {
+    putVariableLength(out, uint64_t(std::max<int64_t>(command.first, 0)));
+    commandData const& cmd = command.second;
+    out.put(char((cmd.pressed ? 0x80 : 0x00) | (cmd.channel & 0x0F)));
+    out.put(char(cmd.id));
+    out.put(char(cmd.velocity));
+  }
+}
+
+bool readCommandLog(std::istream& in, std::vector<timedCommand>& commands) {
+  char tag[sizeof(LOG_TAG)];
+  uint8_t version;
+
+  if (!in.read(tag, sizeof(tag)) || std::memcmp(tag, LOG_TAG, sizeof(tag)) != 0)
+    return false;
+  if (!getByte(in, version) || version != LOG_VERSION) return false;
+
+  uint64_t dt;
+  uint8_t flags, id, velocity;
+
+  while (in.peek() != std::istream::traits_type::eof()) {
+    if (!getVariableLength(in, dt) || !getByte(in, flags)
+     || !getByte(in, id) || !getByte(in, velocity))
+      return false;
+
+    commands.push_back({
+      int64_t(dt),
+      { bool(flags & 0x80), id, velocity, uint8_t(flags & 0x0F) }
+    });
+  }
+
+  return true;
+}
+
+bool readMidiFileCommands(std::istream& in, std::vector<timedCommand>& commands) {
+  char tag[4];
+  uint32_t length, format, trackCount, division;
+
+  if (!in.read(tag, 4) || std::memcmp(tag, "MThd", 4) != 0) return false;
+  if (!getBigEndian(in, length, 4) || length < 6) return false;
+  if (!getBigEndian(in, format, 2) || !getBigEndian(in, trackCount, 2)
+   || !getBigEndian(in, division, 2))
+    return false;
+  if (format > 1) return false;
+  in.ignore(length - 6);
+
+  std::vector<trackEvent> events;
+  std::vector<uint8_t> bytes;
+
+  for (uint32_t track = 0; track < trackCount;) {
+    if (!in.read(tag, 4) || !getBigEndian(in, length, 4)) return false;
+
+    bytes.resize(length);
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), length)) return false;
+
+    if (std::memcmp(tag, "MTrk", 4) != 0) continue; // unknown chunks are skipped
+
+    if (!readTrack(bytes, events)) return false;
+    track++;
+  }
+
+  // Tracks were read one after another : a stable sort keeps
+  // simultaneous events in track order.
+
+  std::stable_sort(events.begin(), events.end(),
+    [](trackEvent const& e1, trackEvent const& e2) { return e1.time < e2.time; });
+
+  uint64_t lastTime = 0;
+  for (auto& event : events) {
+    commands.push_back({ int64_t(event.time - lastTime), event.cmd });
+    lastTime = event.time;
+  }
+
+  return true;
+}
+
+// REPLAYS /////////////////////////////////////////////////////////////////////
+
+uint64_t hash(MFPRenderer& renderer, std::vector<timedCommand> const& commands) {
+  uint64_t h = FNV_OFFSET;
+  for (auto& command : commands) hashResult(h, renderer.combine(command.second));
+  return h;
+}
+
+uint64_t hash(performance const& output) {
+  uint64_t h = FNV_OFFSET;
+  for (auto& result : output) hashResult(h, result);
+  return h;
+}
+
+performance render(MFPRenderer& renderer, std::vector<timedCommand> const& commands) {
+  performance res;
+  res.reserve(commands.size());
+  for (auto& command : commands) res.push_back(renderer.combine(command.second));
+  return res;
+}
+
+mismatch diff(MFPRenderer& renderer,
+              std::vector<timedCommand> const& commands,
+              performance const& golden) {
+  for (std::size_t i = 0; i < commands.size(); i++) {
+    std::vector<noteData> actual = renderer.combine(commands[i].second);
+
+    if (i >= golden.size()) return { true, i, {}, actual };
+    if (!sameResult(actual, golden[i])) return { true, i, golden[i], actual };
+  }
+
+  if (golden.size() > commands.size())
+    return { true, commands.size(), golden[commands.size()], {} };
+
+  return { false, commands.size(), {}, {} };
+}
+
+} /* END NAMESPACE Replay */
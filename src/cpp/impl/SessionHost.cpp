@@ -0,0 +1,174 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <pthread.h>
+#endif
+#include "../../include/core/RingBuffer.h"
+#include "../../include/impl/SessionHost.h"
+
+// MESSAGES ////////////////////////////////////////////////////////////////////
+
+namespace {
+
+enum class messageType { CREATE, COMMAND, CLOSE };
+
+struct message {
+  messageType type;
+  SessionHost::sessionId id;
+  commandData cmd;
+  CombineMode mode;
+  SessionHost::sharedPartition partition; // Only set for CREATE
+};
+
+// Number of empty polls before a shard thread goes to sleep.
+// Spinning a little keeps the latency low under a steady flow of commands.
+
+const int SPIN_COUNT = 64;
+
+// Upper bound on the sleep of an idle shard,
+// in case a wake up is missed between its last poll and its sleep.
+
+const std::chrono::milliseconds IDLE_TIMEOUT(1);
+
+} /* END ANONYMOUS NAMESPACE */
+
+// SHARDS //////////////////////////////////////////////////////////////////////
+
+struct SessionHost::shard {
+  RingBuffer<message> queue;
+  outputCallback output;
+
+  std::unordered_map<sessionId, std::unique_ptr<MFPRenderer>> sessions;
+  // Only ever accessed by the thread of the shard.
+
+  std::atomic<bool> running;
+  std::atomic<bool> sleeping;
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+
+  std::thread thread;
+
+  shard(outputCallback o, std::size_t capacity) :
+    queue(capacity), output(o), running(true), sleeping(false) {}
+
+  void process(message& m) {
+    switch (m.type) {
+      case messageType::CREATE: {
+        // The copy of the partition is made here,
+        // so that it belongs to the thread of the shard.
+        std::unique_ptr<MFPRenderer> session(new MFPRenderer());
+        session->setPartition(*m.partition);
+        session->setCombineMode(m.mode);
+        sessions[m.id] = std::move(session);
+        break;
+      }
+      case messageType::COMMAND: {
+        auto session = sessions.find(m.id);
+        if (session == sessions.end()) break;
+        Events::Set<noteData> res = session->second->combineSet(m.cmd);
+        if (output) output(m.id, res);
+        break;
+      }
+      case messageType::CLOSE:
+        sessions.erase(m.id);
+        break;
+    }
+  }
+
+  void run() {
+    message m;
+    int idlePolls = 0;
+
+    while (true) {
+      if (queue.pop(m)) {
+        process(m);
+        idlePolls = 0;
+        continue;
+      }
+
+      // Only stop once the queue is drained.
+      if (!running.load(std::memory_order_acquire)) break;
+
+      if (++idlePolls < SPIN_COUNT) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      sleeping.store(true, std::memory_order_seq_cst);
+      if (queue.empty() && running.load(std::memory_order_acquire))
+        wakeUp.wait_for(lock, IDLE_TIMEOUT);
+      sleeping.store(false, std::memory_order_relaxed);
+      idlePolls = 0;
+    }
+
+    sessions.clear();
+  }
+
+  bool send(message&& m) {
+    if (!queue.push(std::move(m))) return false;
+    notify();
+    return true;
+  }
+
+  void notify() {
+    if (sleeping.load(std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      wakeUp.notify_one();
+    }
+  }
+
+  void pin(std::size_t core) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % CPU_SETSIZE, &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+#endif
+  }
+};
+
+// CONSTRUCTORS/DESTRUCTORS ////////////////////////////////////////////////////
+
+SessionHost::SessionHost(outputCallback output,
+                         std::size_t shardCount,
+                         std::size_t queueCapacity,
+                         bool pinThreads) {
+  if (shardCount == 0) shardCount = std::thread::hardware_concurrency();
+  if (shardCount == 0) shardCount = 1;
+
+  for (std::size_t i = 0; i < shardCount; i++) {
+    shards.emplace_back(new shard(output, queueCapacity));
+    shard& s = *shards.back();
+    s.thread = std::thread([&s]() { s.run(); });
+    if (pinThreads) s.pin(i);
+  }
+}
+
+SessionHost::~SessionHost() {
+  for (auto& s : shards) {
+    s->running.store(false, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(s->sleepMutex);
+    s->wakeUp.notify_one();
+  }
+  for (auto& s : shards) s->thread.join();
+}
+
+// PUBLIC METHODS //////////////////////////////////////////////////////////////
+
+bool SessionHost::createSession(sessionId id, sharedPartition partition,
+                                CombineMode mode) {
+  return shardOf(id).send({ messageType::CREATE, id, {}, mode, partition });
+}
+
+bool SessionHost::sendCommand(sessionId id, commandData cmd) {
+  return shardOf(id).send({ messageType::COMMAND, id, cmd, CombineMode::COMBINE_3, nullptr });
+}
+
+bool SessionHost::closeSession(sessionId id) {
+  return shardOf(id).send({ messageType::CLOSE, id, {}, CombineMode::COMBINE_3, nullptr });
+}
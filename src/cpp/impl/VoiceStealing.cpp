@@ -1,4 +1,5 @@
-#include <map>
+#include <array>
+#include <bitset>
 #include "../../include/impl/VoiceStealing.h"
 
 namespace VoiceStealing {
@@ -11,7 +12,7 @@ namespace VoiceStealing {
 
 class None : public Strategy {
 public:
-  void preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) {}
+  bool preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) { return false; }
   void reset() {}
 };
 
@@ -21,23 +22,27 @@ public:
 class LastNoteOffWins : public Strategy {
 private:
 
-  std::map<noteKey, std::uint8_t> triggerCountMap;
+  // Number of note ons in a row for each note, 0 when it isn't sounding.
+  // Indexed by Events::DenseKey, so it lives inside the strategy.
+
+  std::array<std::uint8_t, Events::DenseKey<noteData>::size> triggerCounts{};
 
 public:
-  void preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) {
+  bool preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) {
     // std::cout < "preventing voice stealing" << std::endl;
 
     std::vector<noteData> addedNoteOffs;
+    bool erased = false;
 
     auto it = notes.begin();
 
     while(it!=notes.end()) {
       auto nData = *it;
-      noteKey key = Events::keyFromData<noteData, noteKey>(nData);
+      std::uint8_t& triggerCount = triggerCounts[Events::DenseKey<noteData>::index(nData)];
 
-      if (triggerCountMap.find(key) == triggerCountMap.end()) { // note was not found
+      if (triggerCount == 0) { // note was not found
         if (nData.on) {
-          triggerCountMap[key] = 1; // register the first trigger of this note
+          triggerCount = 1; // register the first trigger of this note
         } else {
           // do nothing ?
           // isn't this an error case ?
@@ -50,41 +55,86 @@ public:
           // insert a note off before it
           addedNoteOffs.push_back({ false, nData.pitch, 0, nData.channel });
           // keep track of simultaneous note ons
-          triggerCountMap[key]++;
+          triggerCount++;
           it++;
-        } else if (triggerCountMap[key] > 1) {
-          notes.erase(it);
+        } else if (triggerCount > 1) {
+          it = notes.erase(it);
+          erased = true;
           // keep track of simultaneous note ons
-          triggerCountMap[key]--;
+          triggerCount--;
         } else {
-          // don't touch anything and remove the entry from the map
-          triggerCountMap.erase(key);
+          // don't touch anything and forget the note
+          triggerCount = 0;
           it++;
         }
       }
     }
 
+    if (addedNoteOffs.empty()) return erased;
+
     addedNoteOffs.insert(addedNoteOffs.end(),notes.begin(),notes.end());
     notes = addedNoteOffs;
+    return true;
   }
 
   void reset() {
-    triggerCountMap.clear();
+    triggerCounts.fill(0);
   }
 };
 
-// ???
+// Force a note off before any note on of a note that is already sounding,
+// so that every note is retriggered from silence.
+// Sounding notes are tracked in a bitset indexed by Events::DenseKey.
 
 class OnlyStaccato : public Strategy {
 private:
 
+  typedef Events::DenseKey<noteData> noteIndex;
+
+  std::bitset<noteIndex::size> soundingNotes;
+
+  std::vector<noteData> staccatoNotes; // reused so that its capacity is kept
+
+  static std::size_t indexOf(noteData const& note) { return noteIndex::index(note); }
+
 public:
-  void preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) {
-    // todo
+  bool preventVoiceStealing(std::vector<noteData>& notes, commandData cmd) {
+    // notes are only copied once a note off has to be inserted,
+    // which leaves the common case without any copy.
+    bool inserting = false;
+
+    for (std::size_t i = 0; i < notes.size(); i++) {
+      noteData const& note = notes[i];
+      std::size_t index = indexOf(note);
+
+      if (note.on && note.velocity != 0) {
+        if (soundingNotes[index]) {
+          if (!inserting) {
+            staccatoNotes.assign(notes.begin(), notes.begin() + i);
+            inserting = true;
+          }
+          staccatoNotes.push_back({ false, note.pitch, 0, note.channel });
+        }
+        soundingNotes.set(index);
+      } else {
+        soundingNotes.reset(index);
+      }
+
+      if (inserting) staccatoNotes.push_back(note);
+    }
+
+    if (inserting) notes.swap(staccatoNotes);
+    return inserting;
   }
 
   void reset() {
-    // todo
+    soundingNotes.reset();
+  }
+
+  // The bitset lives inside the strategy : only the buffer is on the heap.
+
+  Footprint::usage memoryUsage() const {
+    return Footprint::ofVector(staccatoNotes);
   }
 };
 
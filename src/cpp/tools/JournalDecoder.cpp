@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <fstream>
+#include "../../include/impl/Journal.h"
+
+// Prints a journal (see Journal.h) as text : its session, then one entry per
+// line : time in microseconds, then the command, the notes played (marked
+// incomplete when some were lost) or the records lost.
+// When a second path is given, the commands are also written there as a
+// command log, to be replayed (see Replay::readCommandLog).
+
+namespace {
+
+void printNote(noteData const& note) {
+  std::printf(" %s:%d:%d:%d", note.on ? "on" : "off",
+              note.pitch, note.velocity, note.channel);
+}
+
+} /* END ANONYMOUS NAMESPACE */
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    std::fprintf(stderr, "usage: %s journal [commandLog]\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  Journal::session session;
+  std::vector<Journal::entry> entries;
+  bool valid = Journal::read(in, session, entries);
+
+  if (valid || !entries.empty()) {
+    std::printf("partition %016llx unmeet:%d complete:%d shift:%d resolution:%d"
+                " clustering:%d stats:%d\n",
+                (unsigned long long)session.partitionKey,
+                session.params.unmeet, session.params.complete,
+                int(session.params.shiftMode), session.params.temporalResolution,
+                int(session.params.clustering), session.params.precomputeStats);
+    std::printf("combine:%d stealing:%d chord:%d commandVelocity:%d\n",
+                int(session.combineMode), int(session.voiceStealing),
+                int(session.chordRendering), session.useCommandVelocity);
+  }
+
+  for (auto& e : entries) {
+    std::printf("%llu.%03llu", (unsigned long long)(e.time / 1000),
+                (unsigned long long)(e.time % 1000));
+
+    switch (e.type) {
+      case Journal::recordType::COMMAND:
+        std::printf(" command %s:%d:%d:%d\n", e.cmd.pressed ? "press" : "release",
+                    e.cmd.id, e.cmd.velocity, e.cmd.channel);
+        break;
+      case Journal::recordType::OUTPUT:
+        std::printf(" output");
+        for (auto& control : e.controls)
+          std::printf(" control:%02x:%d:%d", control.status, control.data1, control.data2);
+        for (auto& note : e.notes) printNote(note);
+        std::printf(e.complete ? "\n" : " incomplete\n");
+        break;
+      default:
+        std::printf(" dropped %u\n", e.dropped);
+        break;
+    }
+  }
+
+  if (!valid) std::fprintf(stderr, "%s is malformed\n", argv[1]);
+
+  if (argc == 3) {
+    std::ofstream out(argv[2], std::ios::binary);
+    Replay::writeCommandLog(out, Journal::commands(entries));
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", argv[2]);
+      return 1;
+    }
+  }
+
+  return valid ? 0 : 1;
+}
@@ -2,10 +2,21 @@
 #define MFP_CHRONOLOGY_H
 
 #include <iostream>
+#include <functional>
+#include <bitset>
 #include <list>
+#include <queue>
+#include "Diagnostics.h"
 #include "Events.h"
+#include "Footprint.h"
 
 namespace ChronologyParams{
+    enum class clusteringOption {
+        DELTA, // An event joins the current set if its own dt is under the resolution
+        WINDOW // An event joins the current set if it falls within the resolution
+        // of the set's first onset
+    };
+
     struct parameters{
         bool unmeet; // Indicates whether or not to displace end events when possible
         // ONLY RELEVANT FOR MODEL DATA. DISABLE FOR COMMANDS.
@@ -20,20 +31,46 @@ namespace ChronologyParams{
         // and merged in a single set.
         // MIDI Standard is 0.
 
+        clusteringOption clustering; // Indicates how temporalResolution is applied.
+        // DELTA compares each event to the previous one, so a chain of small
+        // deltas can merge indefinitely. WINDOW anchors the window at the
+        // first onset of the set, so a slowly rolled chord spanning more than
+        // the resolution is split into several sets.
+
+        bool precomputeStats; // Indicates whether or not to attach Events::SetStats
+        // to each starting set at finalize time, so that combining doesn't
+        // have to compute them. ONLY RELEVANT FOR MODEL DATA.
+
         uint64_t date; // Unused for now, purpose unknown
     };
 
     static parameters constexpr default_params = {
         .unmeet = true,
         .complete = false,
+        .shiftMode = Events::correspondOption::PITCH_AND_CHANNEL,
         .temporalResolution = 0,
+        .clustering = clusteringOption::DELTA,
+        .precomputeStats = false,
         .date = 0
     };
 
     static parameters constexpr no_unmeet = {
         .unmeet = false,
         .complete = false,
+        .shiftMode = Events::correspondOption::PITCH_AND_CHANNEL,
+        .temporalResolution = 0,
+        .clustering = clusteringOption::DELTA,
+        .precomputeStats = false,
+        .date = 0
+    };
+
+    static parameters constexpr command_params = {
+        .unmeet = false,
+        .complete = false,
+        .shiftMode = Events::correspondOption::NONE,
         .temporalResolution = 0,
+        .clustering = clusteringOption::DELTA,
+        .precomputeStats = false,
         .date = 0
     };
 }
@@ -45,8 +82,38 @@ class Chronology {
   // ------------------------------DATA TYPES-----------------------------------
   // ---------------------------------------------------------------------------
 
+public:
+
+  // Reads the next event of a track into (dt, data), dt being relative to the
+  // previous event of the same track. Returns false once the track is exhausted.
+
+  typedef std::function<bool(int64_t&, T&)> trackReader;
+
+  // Heap memory held by a chronology, per component (see Footprint.h).
+
+  struct footprint{
+    Footprint::usage fifo; // The sets waiting to be pulled
+    Footprint::usage pending; // The inputSet and bufferSet
+    Footprint::usage incompleteEvents; // The copies kept to complete them later
+
+    Footprint::usage total() const { return fifo + pending + incompleteEvents; }
+  };
+
 private:
 
+  // The next event of a track, waiting in the merge heap of pushTracks.
+  // Simultaneous events are ordered by track index, then by order within the track.
+
+  struct trackHead{
+    int64_t time; // absolute time of the event
+    std::size_t track; // index of the track it was read from
+    T data;
+
+    bool operator>(const trackHead& head) const {
+      return time > head.time || (time == head.time && track > head.track);
+    }
+  };
+
   // Describes a place where a set containing at least one beginning event
   // was left without immediate ending
 
@@ -64,12 +131,22 @@ private:
 
   Events::Set<T> inputSet; // Set containing the most recent input
 
+  int64_t inputSetSpan; // Time elapsed between the first and the last event
+  // merged into the inputSet. Lets WINDOW clustering stay streaming.
+
   Events::Set<T> bufferSet; // Set containing previous data
   // not yet pushed to the fifo, to be altered depending on various conditions
 
   std::list<Events::Set<T>> fifo; // The user-facing front of the chronology.
   // It is where events are pushed to and pulled from.
 
+  bool hasPushedSets; // Whether a set has been pushed to the fifo since the last clear().
+  // Unlike checking the fifo for emptiness, stays true when sets are pulled during pushes.
+
+  Events::SideLane<T> pendingSide; // Side events waiting for the next start
+  int64_t pendingSideDt; // Time elapsed since the last event, through side events
+  // and dropped events
+
   std::list<struct incompleteEventSet> incompleteEvents; // The events for which
   // a beginning was pushed, but no immediate end
   // kept track of in case the ending is found later
@@ -85,15 +162,31 @@ private:
                           Events::Set<T> const& bufferSet,
                           Events::Set<T>& insertSet) {
 
+    // With a dense key, only the starts having an ending in the inputSet
+    // are searched for, which leaves the common case without any search.
+
+    std::bitset<Events::DenseKey<T>::size> endingKeys;
+    if constexpr (Events::DenseKey<T>::enabled) {
+      if (usesDenseKey()) {
+        for (auto& inputEvent : inputSet.events)
+          if (!Events::isStart<T>(inputEvent)) endingKeys.set(Events::DenseKey<T>::index(inputEvent));
+        if (endingKeys.none()) return false;
+      }
+    }
+
     for (auto& bufferEvent : bufferSet.events) {
+      if constexpr (Events::DenseKey<T>::enabled) {
+        if (usesDenseKey() && !endingKeys[Events::DenseKey<T>::index(bufferEvent)]) continue;
+      }
+
       if (Events::isStart<T>(bufferEvent)) {
-        auto it = inputSet.events.begin();
-        while (it != inputSet.events.end()) {
-          if (Events::isMatchingEnd(bufferEvent,*it,params.shiftMode)) {
-            insertSet.events.push_back(*it);
-            it = inputSet.events.erase(it);
+        std::size_t i = 0;
+        while (i < inputSet.events.size()) {
+          if (Events::isMatchingEnd(bufferEvent,inputSet.events[i],params.shiftMode)) {
+            Events::appendEvent(insertSet,inputSet.events[i]);
+            Events::eraseEvent(inputSet,i);
           } else {
-            it++;
+            i++;
           }
         }
       }
@@ -114,6 +207,60 @@ private:
     if (!incompleteEvents.empty()) std::erase_if(incompleteEvents, predicate);
   }
 
+  // Add an event to the inputSet, or begin a new one (see pushEvent).
+
+  void pushToInputSet(int64_t dt, T const& data) {
+
+    // This only happens on start or after calling finalize() or clear() ;
+    // the inputSet is made to be the first input.
+
+    if (inputSet.events.empty()) {
+      inputSet = {dt, {data}, {}, {}, {}};
+      inputSetSpan = 0;
+      return;
+    }
+
+    // Before doing anything else, check whether the current inputSet
+    // can complete a previously incomplete event.
+
+    if (params.complete) checkForEventCompletion();
+
+    // In WINDOW mode, the distance is measured from the first onset of the set
+    // rather than from the previous event.
+
+    int64_t onsetDistance = dt;
+    if (params.clustering == ChronologyParams::clusteringOption::WINDOW)
+      onsetDistance += inputSetSpan;
+
+    if (onsetDistance > params.temporalResolution) { // Event begins at a different time ; inputSet and bufferSet will change
+
+      genericPushLogic(false);
+
+      // The inputSet is now the most recent input.
+      // Its dt stays relative to the previous onset in WINDOW mode.
+      inputSet = {onsetDistance, {data}, {}, {}, {}};
+      inputSetSpan = 0;
+
+    } else { // this is a synchronized event ; just append to the input.
+      inputSetSpan += dt;
+      Events::appendEvent(inputSet, data, inputSetSpan);
+    }
+
+    //std::cout << *this << std::endl;
+  }
+
+  // Whether events can be matched through Events::DenseKey
+  // with the correspondOption of the chronology.
+
+  bool usesDenseKey() const {
+    return Events::DenseKey<T>::enabled && Events::DenseKey<T>::covers(params.shiftMode);
+  }
+
+  void pushToFifo(Events::Set<T> const& set) {
+    fifo.push_back(set);
+    hasPushedSets = true;
+  }
+
   // The set of steps followed when modifying or pushing the bufferSet and inputSet.
   // Used by pushEvent to update the chronology, but also lastPush to finalize it.
 
@@ -127,7 +274,7 @@ private:
 
         Events::mergeSets(bufferSet,inputSet);
         bufferSet.dt += inputSet.dt;
-        if (last) fifo.push_back(bufferSet);
+        if (last) pushToFifo(bufferSet);
         return;
 
       } else { // the inputSet is a starting set (it has a least one start event)
@@ -135,11 +282,11 @@ private:
         // Guard against pushing an empty set in the first position of the fifo
         // Pushing an empty set in other cases is fine, it is an artifical ending
 
-        if (!fifo.empty()) {
-          fifo.push_back(bufferSet);
+        if (hasPushedSets) {
+          pushToFifo(bufferSet);
         }
 
-        if (last) fifo.push_back(inputSet);
+        if (last) pushToFifo(inputSet);
         else bufferSet = inputSet;
 
         return;
@@ -149,25 +296,25 @@ private:
 
       // The bufferSet is a starting set
 
-      fifo.push_back(bufferSet); // First, push it.
+      pushToFifo(bufferSet); // First, push it.
 
       if (Events::hasStart<T>(inputSet)) { // The inputSet is ALSO a starting set.
         // so the two will have to be separated by an empty set,
         // EXCEPT if unmeet is enabled.
-        Events::Set<T> insertSet{inputSet.dt, {}};
+        Events::Set<T> insertSet{inputSet.dt, {}, {}, {}, {}};
 
         // If unmeet is enabled, try to fill the empty set.
         if (params.unmeet) constructInsertSet(inputSet,bufferSet,insertSet);
 
         // Push the set regardless to stay consistent with the format.
-        fifo.push_back(insertSet);
+        pushToFifo(insertSet);
 
         // If it IS empty, register the bufferSet as incomplete.
         if (params.complete && insertSet.events.empty())
             incompleteEvents.push_back({bufferSet,&fifo.back()});
       }
 
-      if (last) fifo.push_back(inputSet);
+      if (last) pushToFifo(inputSet);
       else bufferSet = inputSet;
 
       return;
@@ -186,40 +333,68 @@ private:
   // (causing that start not to play)
   // before said start in the set.
 
-  void shiftSameEventEndings(){
+  void shiftSameEventEndings(Events::Set<T>& set){
       std::vector<T> otherEvents;
+      std::vector<int64_t> otherOffsets;
       std::vector<T> endingsToShift;
       bool matched=false;
 
-      for(Events::Set<T>& set : fifo){
-          otherEvents.clear();
-          endingsToShift.clear();
-          matched=false;
+      int eventIndex = 0;
 
-          int eventIndex = 0;
+      // With a dense key, the starts seen so far are kept in a table
+      // instead of being compared one by one.
+      std::bitset<Events::DenseKey<T>::size> startedKeys;
 
-          for(T const& event : set.events){
+      for(T const& event : set.events){
 
-              for(T const& otherEvent : otherEvents){
-
-                  if(Events::isStart<T>(otherEvent)
-                  && Events::isMatchingEnd(otherEvent,event,params.shiftMode)){
-                      matched=true;
+          if constexpr (Events::DenseKey<T>::enabled) {
+              if (usesDenseKey()) {
+                  std::size_t key = Events::DenseKey<T>::index(event);
+                  if (Events::isStart<T>(event)) startedKeys.set(key);
+                  else if (startedKeys[key]) {
+                      matched = true;
                       endingsToShift.push_back(event);
-                      break;
                   }
+              }
+          }
+
+          if (!usesDenseKey()) for(T const& otherEvent : otherEvents){
 
+              if(Events::isStart<T>(otherEvent)
+              && Events::isMatchingEnd(otherEvent,event,params.shiftMode)){
+                  matched=true;
+                  endingsToShift.push_back(event);
+                  break;
               }
 
-              if(!matched) otherEvents.push_back(event);
-              matched = false;
+          }
 
+          if(!matched){
+              otherEvents.push_back(event);
+              otherOffsets.push_back(Events::offsetOf(set,eventIndex));
           }
+          matched = false;
+          eventIndex++;
 
-          Events::Set<T> newSet = { set.dt, endingsToShift };
-          Events::mergeSets(newSet,otherEvents);
-          set = newSet;
       }
+
+      // Shifted endings are played first, so they lose their offset.
+
+      Events::Set<T> newSet = { set.dt, endingsToShift, {}, {}, {} };
+      newSet.side = std::move(set.side);
+      Events::mergeSets(newSet,otherEvents);
+      if(!set.offsets.empty()){
+          newSet.offsets.assign(endingsToShift.size(), 0);
+          newSet.offsets.insert(newSet.offsets.end(), otherOffsets.begin(), otherOffsets.end());
+      }
+      set = newSet;
+  }
+
+  // The last steps of finalize(), applied to each set.
+
+  void finishSet(Events::Set<T>& set){
+      shiftSameEventEndings(set);
+      if(params.precomputeStats && Events::hasStart<T>(set)) Events::computeStats<T>(set);
   }
 
   // ---------------------------------------------------------------------------
@@ -237,8 +412,11 @@ public:
   // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
   // ---------------------------------------------------------------------------
 
-  Chronology() : params(ChronologyParams::default_params) {}
-  Chronology(ChronologyParams::parameters initParams) : params(initParams) {}
+  Chronology() :
+    params(ChronologyParams::default_params), inputSetSpan(0), hasPushedSets(false),
+    pendingSideDt(0) {}
+  Chronology(ChronologyParams::parameters initParams) :
+    params(initParams), inputSetSpan(0), hasPushedSets(false), pendingSideDt(0) {}
   ~Chronology() {}
 
   // ---------------------------------------------------------------------------
@@ -249,39 +427,117 @@ public:
 
   typename std::list<Events::Set<T>>::iterator end() { return fifo.end(); }
 
-  std::size_t size() { return fifo.size(); }
+  typename std::list<Events::Set<T>>::const_iterator begin() const { return fifo.begin(); }
 
-  // Called when a new event is added to the chronology.
+  typename std::list<Events::Set<T>>::const_iterator end() const { return fifo.end(); }
 
-  void pushEvent(int dt, T const& data) {
+  std::size_t size() const { return fifo.size(); }
 
-    // This only happens on start or after calling finalize() or clear() ;
-    // the inputSet is made to be the first input.
+  // Called when a new event is added to the chronology.
+  // Events out of the range of their key are dropped, their dt counting in
+  // the next event (see Events::DenseKey).
 
-    if (inputSet.events.empty()) {
-      inputSet = {dt, {data}};
+  void pushEvent(int64_t dt, T const& data) {
+    if (!Events::DenseKey<T>::inRange(data)) {
+      Diagnostics::warning("event out of range dropped");
+      pendingSideDt += dt;
       return;
     }
 
-    // Before doing anything else, check whether the current inputSet
-    // can complete a previously incomplete event.
+    dt += pendingSideDt;
+    pendingSideDt = 0;
 
-    if (params.complete) checkForEventCompletion();
+    pushToInputSet(dt, data);
 
-    if (dt > params.temporalResolution) { // Event begins at a different time ; inputSet and bufferSet will change
+    // Side events pushed since the last start are carried by this one's set.
 
-      genericPushLogic(false);
+    if (Events::isStart<T>(data)) {
+      Events::appendSideLane(inputSet.side, pendingSide);
+      pendingSide = Events::SideLane<T>();
+    }
+  }
 
-      // The inputSet is now the most recent input.
-      inputSet = {dt, {data}};
+  // Called when an event taking no part in matching is added (see Events::SideLane).
+  // It is carried by the set of the next start, or by the final ending set
+  // if no start follows (e.g. a pedal up after the last note on), to be played
+  // with the last release. dt counts as for pushEvent.
 
-    } else { // this is a synchronized event ; just append to the input.
-      inputSet.events.push_back(data);
+  template <typename S>
+  void pushSideEvent(int64_t dt, S const& data) {
+    pendingSideDt += dt;
+    pendingSide.events.push_back(data);
+  }
+
+  // ---------------------------------------------------------------------------
+
+  // Called to push several independent tracks at once (e.g. a Type-1 MIDI file).
+  // The tracks are merged on absolute time with a heap holding one event per
+  // track, so no merged copy of the whole stream is ever built.
+
+  void pushTracks(std::vector<trackReader> tracks) {
+    std::priority_queue<trackHead,
+                        std::vector<trackHead>,
+                        std::greater<trackHead>> heads;
+
+    int64_t dt;
+    T data;
+
+    for (std::size_t track = 0; track < tracks.size(); track++) {
+      if (tracks[track](dt, data)) heads.push({dt, track, data});
     }
 
-    //std::cout << *this << std::endl;
+    int64_t lastTime = 0;
+
+    while (!heads.empty()) {
+      trackHead head = heads.top();
+      heads.pop();
+
+      pushEvent(head.time - lastTime, head.data);
+      lastTime = head.time;
+
+      if (tracks[head.track](dt, data))
+        heads.push({head.time + dt, head.track, data});
+    }
+  }
+
+  // Same as above, for tracks given as ranges of (dt, event) pairs.
+
+  template <typename Iterator>
+  void pushTracks(std::vector<std::pair<Iterator, Iterator>> const& ranges) {
+    std::vector<trackReader> tracks;
+    tracks.reserve(ranges.size());
+
+    for (auto& range : ranges) {
+      Iterator it = range.first;
+      Iterator end = range.second;
+
+      tracks.push_back([it, end](int64_t& dt, T& data) mutable {
+        if (it == end) return false;
+        dt = it->first;
+        data = it->second;
+        ++it;
+        return true;
+      });
+    }
+
+    pushTracks(tracks);
+  }
+
+  // ---------------------------------------------------------------------------
+
+  // Called to append a set as is, without any of the preprocessing of pushEvent
+  // (e.g. recorded commands, or rendered model events).
+  // A set with a dt of 0 is merged into the previous one.
+
+  void pushSet(Events::Set<T> const& set) {
+    if (set.dt == 0 && !fifo.empty()) Events::mergeSets(fifo.back(), set);
+    else pushToFifo(set);
   }
 
+  // Append a set taken from another finalized chronology, never merging it.
+
+  void pushFinalizedSet(Events::Set<T> const& set) { pushToFifo(set); }
+
   // ---------------------------------------------------------------------------
 
   // Called after all events have been pushed, and the chronology is ready.
@@ -293,21 +549,94 @@ public:
     lastPush();
 
     if (Events::hasStart<T>(inputSet)) {
-      fifo.push_back({1, {}});
+      fifo.push_back({1, {}, {}, {}, {}});
     }
 
+    // Side events left after the last start are carried by the final ending set,
+    // which is always one of the sets pushed above : the sets already streamed
+    // (see pullFinalEventsSet) are left untouched.
+
+    if (!fifo.empty()) Events::appendSideLane(fifo.back().side, pendingSide);
+
+    pendingSide = Events::SideLane<T>();
+    pendingSideDt = 0;
+
     // Ensure no start events precede a corresponding end event in any set.
+    // Then attach the statistics of each set if requested.
 
-    shiftSameEventEndings();
+    for (Events::Set<T>& set : fifo) finishSet(set);
 
-    // Reset the inner sets.
+    // Reset the inner sets. Incomplete events can no longer be completed.
 
     bufferSet.events.clear();
     inputSet.events.clear();
+    bufferSet.side = inputSet.side = Events::SideLane<T>();
+    incompleteEvents.clear();
 
     //std::cout << *this << std::endl;
   }
 
+  // Append another finalized chronology to this one, e.g. to chain the pieces
+  // of a setlist. Both should be finalized : the sets are moved without copy,
+  // in constant time, and other is left empty.
+  // The alternation of starts and ends is kept at the boundary :
+  // an empty set is inserted between two starting sets, two ending sets are
+  // merged (their dts adding up, as when pushing events), and an empty set
+  // is added at the end only if the result would otherwise end with a start.
+
+  void append(Chronology<T>&& other) {
+    if (other.fifo.empty()) return;
+
+    if (!fifo.empty()) {
+      bool lastIsStart = Events::hasStart<T>(fifo.back());
+      bool nextIsStart = Events::hasStart<T>(other.fifo.front());
+
+      if (lastIsStart && nextIsStart) {
+        pushToFifo({1, {}, {}, {}, {}});
+      } else if (!lastIsStart && !nextIsStart) {
+        Events::mergeSets(fifo.back(), other.fifo.front());
+        fifo.back().dt += other.fifo.front().dt;
+        other.fifo.pop_front();
+      }
+    }
+
+    fifo.splice(fifo.end(), other.fifo);
+
+    if (!fifo.empty() && Events::hasStart<T>(fifo.back())) pushToFifo({1, {}, {}, {}, {}});
+
+    hasPushedSets = hasPushedSets || !fifo.empty();
+    other.clear();
+  }
+
+  // Replace the sets from first to last by those of another finalized
+  // chronology, moved without copy. Unlike append, nothing is done at the
+  // boundaries : the caller keeps the alternation of starts and ends
+  // (see EditableChronology). Returns the first moved set, or last if none.
+
+  typename std::list<Events::Set<T>>::iterator replace(
+    typename std::list<Events::Set<T>>::iterator first,
+    typename std::list<Events::Set<T>>::iterator last,
+    Chronology<T>&& other
+  ) {
+    fifo.erase(first, last);
+    typename std::list<Events::Set<T>>::iterator res =
+      other.fifo.empty() ? last : other.fifo.begin();
+    fifo.splice(last, other.fifo);
+    hasPushedSets = hasPushedSets || !fifo.empty();
+    other.clear();
+    return res;
+  }
+
+  // Whether some starting sets still wait for the ending that would fill
+  // the empty set following them (see params.complete).
+  // The events pushed so far are checked first, so this is final until
+  // another event is pushed. Always false once finalized.
+
+  bool hasIncompleteEvents() {
+    if (params.complete) checkForEventCompletion();
+    return !incompleteEvents.empty();
+  }
+
   // Self-explanatory.
 
   bool hasEvents() {
@@ -324,35 +653,75 @@ public:
       return std::vector<T>();
     }
 
-    res = fifo.front();
+    res = std::move(fifo.front());
     fifo.pop_front();
 
-    /*std::cout << "C++ debug : pulled events = [ ";
-    for(T& e : res.events){
-        std::cout << e << " , ";
-    }
-    std::cout << " ]" << std::endl;*/
+    MFP_DEBUG("pulled {} events", res.events.size());
 
     return res.events;
   }
 
+  // Whether the first set of the fifo will no longer be modified by further pushes.
+  // Every set pushed to the fifo is, except the empty sets following an incomplete event,
+  // which may still receive its ending (see params.complete).
+
+  bool hasFinalEventsSet() const {
+    if (fifo.empty()) return false;
+    for (auto& incomplete : incompleteEvents) {
+      if (incomplete.followingEmptySet == &fifo.front()) return false;
+    }
+
+    return true;
+  }
+
+  // Pull the first set while events are still being pushed, i.e. before finalize().
+  // Only valid if hasFinalEventsSet() : the set is finished
+  // the same way finalize() would have, so the result is identical.
+
+  Events::Set<T> pullFinalEventsSet() {
+    Events::Set<T> res = std::move(fifo.front());
+    fifo.pop_front();
+    finishSet(res);
+    return res;
+  }
+
   Events::Set<T> pullEventsSet() {
     if (!this->hasEvents()){
-      return {0,std::vector<T>()};
+      return {0, std::vector<T>(), {}, {}, {}};
     }
 
-    Events::Set<T> res = fifo.front();
+    Events::Set<T> res = std::move(fifo.front());
     fifo.pop_front();
 
     return res;
   }
 
+  footprint memoryUsage() const {
+    footprint res = {
+      Footprint::ofList(fifo),
+      Footprint::ofSet(inputSet) + Footprint::ofSet(bufferSet),
+      { 0, 0 }
+    };
+
+    for (auto& incomplete : incompleteEvents) {
+      std::size_t node = sizeof(incomplete) + Footprint::LIST_NODE_OVERHEAD;
+      res.incompleteEvents += Footprint::usage{ node, node } + Footprint::ofSet(incomplete.set);
+    }
+
+    return res;
+  }
+
   // Completely reset the chronology.
 
   void clear() {
     fifo.clear();
+    incompleteEvents.clear();
     inputSet.events.clear();
     bufferSet.events.clear();
+    bufferSet.side = inputSet.side = pendingSide = Events::SideLane<T>();
+    pendingSideDt = 0;
+    inputSetSpan = 0;
+    hasPushedSets = false;
   }
 };
 
@@ -0,0 +1,311 @@
+#ifndef MFP_CHRONOLOGYVIEWS_H
+#define MFP_CHRONOLOGYVIEWS_H
+
+#include <iterator>
+#include <utility>
+#include "Chronology.h"
+
+// Lazy traversal of chronologies.
+// Every view here is a range of Events::Set<T> usable in a range-based for loop,
+// producing sets one at a time : stopping early never materializes the rest.
+// A finalized Chronology is itself such a range, through begin() and end().
+
+namespace ChronologyViews {
+
+// -----------------------------------------------------------------------------
+// ---------------------------LAZY CHRONOLOGY-----------------------------------
+// -----------------------------------------------------------------------------
+
+// Builds the sets of a chronology from a range of raw (dt, event) pairs,
+// pushing events only until the next set is final.
+
+template <typename T, typename Iterator>
+class LazyChronology {
+
+  Chronology<T> chronology;
+  Iterator next; // Next raw event to push
+  Iterator last;
+  bool finalized;
+
+  // Push events until a set can be pulled.
+  // Returns false once every set has been pulled.
+
+  bool fetch(Events::Set<T>& set) {
+    while (!finalized && !chronology.hasFinalEventsSet()) {
+      if (next == last) {
+        chronology.finalize();
+        finalized = true;
+      } else {
+        chronology.pushEvent(next->first, next->second);
+        ++next;
+      }
+    }
+
+    if (finalized) {
+      if (!chronology.hasEvents()) return false;
+      set = chronology.pullEventsSet();
+    } else {
+      set = chronology.pullFinalEventsSet();
+    }
+
+    return true;
+  }
+
+public:
+
+  class iterator {
+    LazyChronology* source; // nullptr once past the end
+    Events::Set<T> current;
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Events::Set<T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Events::Set<T> const* pointer;
+    typedef Events::Set<T> const& reference;
+
+    iterator(LazyChronology* s) : source(s) {
+      if (source && !source->fetch(current)) source = nullptr;
+    }
+
+    reference operator*() const { return current; }
+    pointer operator->() const { return &current; }
+
+    iterator& operator++() {
+      if (!source->fetch(current)) source = nullptr;
+      return *this;
+    }
+
+    bool operator==(iterator const& it) const { return source == it.source; }
+    bool operator!=(iterator const& it) const { return source != it.source; }
+  };
+
+  LazyChronology(Iterator first, Iterator last,
+                 ChronologyParams::parameters params) :
+    chronology(params), next(first), last(last), finalized(false) {}
+
+  // Single pass : begin() resumes where the previous traversal stopped.
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(nullptr); }
+};
+
+template <typename T, typename Iterator>
+LazyChronology<T, Iterator> lazySets(
+  Iterator first, Iterator last,
+  ChronologyParams::parameters params = ChronologyParams::default_params
+) {
+  return LazyChronology<T, Iterator>(first, last, params);
+}
+
+// -----------------------------------------------------------------------------
+// -------------------------------ADAPTERS--------------------------------------
+// -----------------------------------------------------------------------------
+
+// Keeps only the events satisfying a predicate in each set.
+// Sets left empty are kept, so that the alternation and the dts are preserved.
+
+template <typename Range, typename Predicate>
+class FilteredSets {
+
+  typedef decltype(std::declval<Range&>().begin()) baseIterator;
+  typedef typename std::decay<decltype(*std::declval<baseIterator>())>::type setType;
+
+  Range range; // A reference if the view was built from an lvalue
+  Predicate predicate;
+
+public:
+
+  class iterator {
+    baseIterator it;
+    Predicate const* predicate;
+    mutable setType current; // Reused for every set
+    mutable bool filtered;
+
+    void filter() const {
+      current.dt = it->dt;
+      current.events.clear();
+      current.offsets.clear();
+      current.stats = decltype(current.stats)(); // May not hold once filtered
+      current.side = it->side; // Side events aren't filtered
+
+      for (std::size_t i = 0; i < it->events.size(); i++) {
+        if ((*predicate)(it->events[i]))
+          Events::appendEvent(current, it->events[i], Events::offsetOf(*it, i));
+      }
+
+      filtered = true;
+    }
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef setType value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef setType const* pointer;
+    typedef setType const& reference;
+
+    iterator(baseIterator i, Predicate const* p) :
+      it(i), predicate(p), filtered(false) {}
+
+    reference operator*() const {
+      if (!filtered) filter();
+      return current;
+    }
+
+    pointer operator->() const { return &**this; }
+
+    iterator& operator++() {
+      ++it;
+      filtered = false;
+      return *this;
+    }
+
+    bool operator==(iterator const& i) const { return it == i.it; }
+    bool operator!=(iterator const& i) const { return it != i.it; }
+  };
+
+  FilteredSets(Range r, Predicate p) :
+    range(std::forward<Range>(r)), predicate(p) {}
+
+  iterator begin() { return iterator(range.begin(), &predicate); }
+  iterator end() { return iterator(range.end(), &predicate); }
+};
+
+template <typename Range, typename Predicate>
+FilteredSets<Range, Predicate> filterEvents(Range&& range, Predicate predicate) {
+  return FilteredSets<Range, Predicate>(std::forward<Range>(range), predicate);
+}
+
+// Applies a function to every event of each set (e.g. a NoteTransform),
+// leaving the dts and offsets unchanged.
+
+template <typename Range, typename Function>
+class TransformedSets {
+
+  typedef decltype(std::declval<Range&>().begin()) baseIterator;
+  typedef typename std::decay<decltype(*std::declval<baseIterator>())>::type setType;
+
+  Range range;
+  Function function;
+
+public:
+
+  class iterator {
+    baseIterator it;
+    Function const* function;
+    mutable setType current; // Reused for every set
+    mutable bool transformed;
+
+    void transform() const {
+      current.dt = it->dt;
+      current.offsets = it->offsets;
+      current.stats = decltype(current.stats)(); // May not hold once transformed
+      current.side = it->side;
+      current.events.resize(it->events.size());
+
+      for (std::size_t i = 0; i < it->events.size(); i++)
+        current.events[i] = (*function)(it->events[i]);
+
+      transformed = true;
+    }
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef setType value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef setType const* pointer;
+    typedef setType const& reference;
+
+    iterator(baseIterator i, Function const* f) :
+      it(i), function(f), transformed(false) {}
+
+    reference operator*() const {
+      if (!transformed) transform();
+      return current;
+    }
+
+    pointer operator->() const { return &**this; }
+
+    iterator& operator++() {
+      ++it;
+      transformed = false;
+      return *this;
+    }
+
+    bool operator==(iterator const& i) const { return it == i.it; }
+    bool operator!=(iterator const& i) const { return it != i.it; }
+  };
+
+  TransformedSets(Range r, Function f) :
+    range(std::forward<Range>(r)), function(f) {}
+
+  iterator begin() { return iterator(range.begin(), &function); }
+  iterator end() { return iterator(range.end(), &function); }
+};
+
+template <typename Range, typename Function>
+TransformedSets<Range, Function> transformEvents(Range&& range, Function function) {
+  return TransformedSets<Range, Function>(std::forward<Range>(range), function);
+}
+
+// Stops before the first set starting after a given time,
+// in the time unit of the dts (e.g. for previews).
+
+template <typename Range>
+class SetsUntil {
+
+  typedef decltype(std::declval<Range&>().begin()) baseIterator;
+  typedef typename std::decay<decltype(*std::declval<baseIterator>())>::type setType;
+
+  Range range;
+  int64_t limit;
+
+public:
+
+  class iterator {
+    baseIterator it;
+    baseIterator last;
+    int64_t elapsed;
+    int64_t limit;
+
+    bool done() const { return it == last || elapsed + it->dt > limit; }
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef setType value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef setType const* pointer;
+    typedef setType const& reference;
+
+    iterator(baseIterator i, baseIterator l, int64_t lim) :
+      it(i), last(l), elapsed(0), limit(lim) {}
+
+    reference operator*() const { return *it; }
+    pointer operator->() const { return &*it; }
+
+    iterator& operator++() {
+      elapsed += it->dt;
+      ++it;
+      return *this;
+    }
+
+    // Only meant to be compared to end().
+
+    bool operator==(iterator const& i) const { return done() == i.done(); }
+    bool operator!=(iterator const& i) const { return done() != i.done(); }
+  };
+
+  SetsUntil(Range r, int64_t l) : range(std::forward<Range>(r)), limit(l) {}
+
+  iterator begin() { return iterator(range.begin(), range.end(), limit); }
+  iterator end() { return iterator(range.end(), range.end(), limit); }
+};
+
+template <typename Range>
+SetsUntil<Range> untilTime(Range&& range, int64_t limit) {
+  return SetsUntil<Range>(std::forward<Range>(range), limit);
+}
+
+} /* end namespace ChronologyViews */
+
+#endif /* MFP_CHRONOLOGYVIEWS_H */
@@ -0,0 +1,175 @@
+#ifndef MFP_DIAGNOSTICS_H
+#define MFP_DIAGNOSTICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include "RingBuffer.h"
+
+// Messages of the library, e.g. about a malformed chronology, delivered to a
+// sink chosen by the application (stderr by default).
+
+// Posting a message never blocks nor allocates, so that it is safe on the
+// thread playing the commands : the message is queued with its format and its
+// integer arguments, and only formatted when the application calls deliver()
+// from another thread. Messages posted while the queue is full are counted
+// and dropped. The only exception is the malformed partition that makes the
+// renderer exit (see Renderer::combine3Set) : it delivers its error first.
+// The queue itself is allocated on first use : init() must be called before
+// the first message is posted from a real-time thread. setSink and the
+// constructors of Renderer and Scheduler do it as well.
+
+// Formats are string literals where each "{}" is replaced by the next argument.
+// Debug messages (MFP_DEBUG) are only compiled with the MFP_DEBUG_DIAGNOSTICS
+// definition (see the CMake option of the same name), and are then posted once
+// the minimum severity is lowered to Debug.
+
+namespace Diagnostics {
+
+enum class severity { Debug, Info, Warning, Error };
+
+typedef std::function<void(severity, std::string const&)> sink;
+
+const std::size_t MAX_ARGUMENTS = 4;
+const std::size_t QUEUE_CAPACITY = 1024;
+
+struct message {
+  severity level;
+  const char* format; // Must outlive the delivery, e.g. a string literal
+  int64_t arguments[MAX_ARGUMENTS];
+  uint8_t argumentCount;
+};
+
+inline const char* nameOf(severity level) {
+  switch (level) {
+    case severity::Debug: return "debug";
+    case severity::Info: return "info";
+    case severity::Warning: return "warning";
+    default: return "error";
+  }
+}
+
+inline void writeToStderr(severity level, std::string const& text) {
+  std::fprintf(stderr, "[MFP %s] %s\n", nameOf(level), text.c_str());
+}
+
+struct channel {
+  RingBuffer<message> queue;
+  std::atomic<int> minimum; // Lowest severity posted
+  std::atomic<uint64_t> dropped;
+
+  std::mutex sinkMutex; // Only taken by deliver and setSink
+  sink output;
+
+  channel() :
+    queue(QUEUE_CAPACITY), minimum(int(severity::Info)), dropped(0),
+    output(writeToStderr) {}
+};
+
+inline channel& instance() {
+  static channel c;
+  return c;
+}
+
+// Replace each "{}" of the format by the next argument.
+
+inline std::string format(message const& m) {
+  std::string res;
+  std::size_t argument = 0;
+
+  for (const char* c = m.format; *c; c++) {
+    if (c[0] == '{' && c[1] == '}' && argument < m.argumentCount) {
+      res += std::to_string(m.arguments[argument++]);
+      c++;
+    } else {
+      res += *c;
+    }
+  }
+
+  return res;
+}
+
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////
+
+// Allocate the queue now rather than at the first message.
+
+inline void init() { instance(); }
+
+inline void setSink(sink s) {
+  channel& c = instance();
+  std::lock_guard<std::mutex> lock(c.sinkMutex);
+  c.output = s;
+}
+
+// Messages of a lower severity are dropped when posted.
+
+inline void setMinimumSeverity(severity level) {
+  instance().minimum.store(int(level), std::memory_order_relaxed);
+}
+
+template <typename... Arguments>
+void post(severity level, const char* format, Arguments... arguments) {
+  static_assert(sizeof...(Arguments) <= MAX_ARGUMENTS, "too many arguments");
+  static_assert(std::conjunction<std::is_integral<Arguments>...>::value,
+                "only integer arguments are supported");
+
+  channel& c = instance();
+  if (int(level) < c.minimum.load(std::memory_order_relaxed)) return;
+
+  message m = { level, format, { int64_t(arguments)... }, sizeof...(Arguments) };
+  if (!c.queue.push(m)) c.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename... Arguments>
+void info(const char* format, Arguments... arguments) {
+  post(severity::Info, format, arguments...);
+}
+
+template <typename... Arguments>
+void warning(const char* format, Arguments... arguments) {
+  post(severity::Warning, format, arguments...);
+}
+
+template <typename... Arguments>
+void error(const char* format, Arguments... arguments) {
+  post(severity::Error, format, arguments...);
+}
+
+// Format the queued messages and pass them to the sink, in the order they
+// were posted. Returns the number of messages delivered.
+// Call it periodically from a thread allowed to block, and before exiting.
+
+inline std::size_t deliver() {
+  channel& c = instance();
+  std::lock_guard<std::mutex> lock(c.sinkMutex);
+
+  std::size_t count = 0;
+  message m;
+
+  while (c.queue.pop(m)) {
+    if (c.output) c.output(m.level, format(m));
+    count++;
+  }
+
+  return count;
+}
+
+// Messages dropped because the queue was full.
+
+inline uint64_t dropped() {
+  return instance().dropped.load(std::memory_order_relaxed);
+}
+
+} /* END NAMESPACE Diagnostics */
+
+#ifdef MFP_DEBUG_DIAGNOSTICS
+#define MFP_DEBUG(...) Diagnostics::post(Diagnostics::severity::Debug, __VA_ARGS__)
+#else
+#define MFP_DEBUG(...) do {} while (0)
+#endif
+
+#endif /* MFP_DIAGNOSTICS_H */
@@ -0,0 +1,391 @@
+#ifndef MFP_EDITABLECHRONOLOGY_H
+#define MFP_EDITABLECHRONOLOGY_H
+
+#include <algorithm>
+#include <list>
+#include <vector>
+#include "Chronology.h"
+
+// A finalized chronology that can still be edited (e.g. from a score editor),
+// without preprocessing the whole score again after each edit.
+
+// The events are kept in segments, each finalized on its own. Segments are cut
+// where the preprocessing of a Chronology can't carry anything over :
+// between an ending set and a starting set, once the segment has had a start,
+// and when no incomplete event is left waiting for its ending.
+// Under these conditions the sets of a segment are exactly the ones
+// a whole chronology would give, so an edit only has to finalize again
+// the segments around it, until the next cut that is still valid.
+// The sets of the segments are kept one after the other in a single
+// chronology, where an edit only replaces the sets of the segments it
+// finalized again : the others are neither copied nor moved.
+
+// Only model events are kept : side events (see Chronology::pushSideEvent)
+// can't be pushed, so a score with controls should use a Chronology.
+
+template <typename T>
+class EditableChronology {
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------------DATA TYPES-----------------------------------
+  // ---------------------------------------------------------------------------
+
+  struct timedEvent{
+    int64_t time; // absolute, in the time unit of the dts
+    T data;
+  };
+
+private:
+
+  typedef typename std::list<Events::Set<T>>::iterator setIterator;
+
+  struct segment{
+    std::vector<timedEvent> events; // in order of time
+    Chronology<T> sets; // the events of the segment alone, finalized,
+    // until they are moved to the whole chronology (see place)
+    setIterator firstSet; // in the whole chronology, once placed
+
+    int64_t leadingDt; // dt of the first event, as seen by a whole chronology
+    bool beginsWithStart; // whether the first set has a start event
+    bool hasStart; // whether any event is a start
+
+    bool closable; // whether the chronology may be cut after the segment :
+    // its last set is an ending set, and no incomplete event is left.
+
+    int64_t lastTime; // time of the last event
+    int64_t lastAnchor; // time of the first event of the last set
+  };
+
+  typedef typename std::list<segment>::iterator segmentIterator;
+
+  // ---------------------------------------------------------------------------
+  // ----------------------------PRIVATE FIELDS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  ChronologyParams::parameters params;
+
+  std::list<segment> segments;
+  Chronology<T> whole; // The sets of every segment, in order
+
+  std::vector<timedEvent> pushedEvents; // Pushed since the last finalize()
+  int64_t pushedTime; // Time of the last pushed event
+
+  // ---------------------------------------------------------------------------
+  // ---------------------------PRIVATE METHODS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Whether an event at time begins a new set, following the clustering rule
+  // of Chronology::pushEvent.
+
+  bool beginsSet(int64_t time, int64_t previousTime, int64_t anchor) const {
+    int64_t distance =
+      params.clustering == ChronologyParams::clusteringOption::WINDOW
+        ? time - anchor : time - previousTime;
+    return distance > params.temporalResolution;
+  }
+
+  // The dt a whole chronology would give to the first set of a segment.
+
+  int64_t leadingDtAfter(int64_t time, int64_t previousTime, int64_t anchor) const {
+    return params.clustering == ChronologyParams::clusteringOption::WINDOW
+      ? time - anchor : time - previousTime;
+  }
+
+  // Split a run of events into segments, finalizing each of them.
+  // The run has to begin a set : previousTime and anchor are the time of the
+  // last event and of the last set before it (0 at the beginning of the score).
+
+  void split(std::vector<timedEvent> const& events,
+             int64_t previousTime, int64_t anchor,
+             std::list<segment>& res) const {
+    if (events.empty()) return;
+
+    // First pass : group the events into sets.
+
+    std::vector<std::size_t> setBegins;
+    std::vector<bool> setHasStart;
+
+    int64_t lastTime = previousTime, lastAnchor = anchor;
+
+    for (std::size_t i = 0; i < events.size(); i++) {
+      if (i == 0 || beginsSet(events[i].time, lastTime, lastAnchor)) {
+        setBegins.push_back(i);
+        setHasStart.push_back(false);
+        lastAnchor = events[i].time;
+      }
+      if (Events::isStart<T>(events[i].data)) setHasStart.back() = true;
+      lastTime = events[i].time;
+    }
+
+    setBegins.push_back(events.size());
+
+    // Second pass : push the sets, cutting wherever possible.
+
+    segment current = {{}, Chronology<T>(params), {}, 0, false, false, false, 0, 0};
+    lastTime = previousTime;
+    lastAnchor = anchor;
+
+    for (std::size_t set = 0; set + 1 < setBegins.size(); set++) {
+      if (set > 0 && current.hasStart && !setHasStart[set - 1] && setHasStart[set]
+       && !current.sets.hasIncompleteEvents()) {
+        current.closable = true;
+        current.sets.finalize();
+        res.push_back(std::move(current));
+        current = {{}, Chronology<T>(params), {}, 0, false, false, false, 0, 0};
+      }
+
+      for (std::size_t i = setBegins[set]; i < setBegins[set + 1]; i++) {
+        timedEvent const& e = events[i];
+        int64_t dt = e.time - lastTime;
+
+        if (current.events.empty()) {
+          dt = leadingDtAfter(e.time, lastTime, lastAnchor);
+          current.leadingDt = dt;
+          current.beginsWithStart = setHasStart[set];
+        }
+
+        current.sets.pushEvent(dt, e.data);
+        current.events.push_back(e);
+        current.hasStart = current.hasStart || Events::isStart<T>(e.data);
+        current.lastTime = lastTime = e.time;
+      }
+
+      current.lastAnchor = lastAnchor = events[setBegins[set]].time;
+    }
+
+    current.closable = !setHasStart[setHasStart.size() - 1]
+                    && !current.sets.hasIncompleteEvents();
+    current.sets.finalize();
+    res.push_back(std::move(current));
+  }
+
+  // Move the sets of new segments to the whole chronology, before the sets
+  // of pos, then the segments themselves before pos.
+
+  void place(segmentIterator pos, std::list<segment>& pieces) {
+    setIterator at = pos == segments.end() ? whole.end() : pos->firstSet;
+    for (auto& piece : pieces) piece.firstSet = whole.replace(at, at, std::move(piece.sets));
+    segments.splice(pos, pieces);
+  }
+
+  // Remove segments along with their sets. Returns the segment after them.
+
+  segmentIterator remove(segmentIterator first, segmentIterator last) {
+    if (first == last) return last;
+    whole.replace(first->firstSet,
+                  last == segments.end() ? whole.end() : last->firstSet,
+                  Chronology<T>(params));
+    return segments.erase(first, last);
+  }
+
+  // Whether the chronology can be cut between two segments.
+
+  bool canCut(segment const& before, segment const& after) const {
+    return before.closable && before.hasStart && after.beginsWithStart
+        && beginsSet(after.events.front().time, before.lastTime, before.lastAnchor);
+  }
+
+  // Apply an edit to the events of the segment holding time,
+  // then finalize again the segments it may affect.
+
+  template <typename Edit>
+  bool edit(int64_t time, Edit apply) {
+    if (segments.empty()) {
+      std::vector<timedEvent> events;
+      if (!apply(events)) return false;
+      std::list<segment> pieces;
+      split(events, 0, 0, pieces);
+      place(segments.end(), pieces);
+      return true;
+    }
+
+    // The edited segment is the last one beginning at or before time.
+    // The one before it is finalized again too, since the cut between them
+    // depends on both.
+
+    segmentIterator edited = segments.begin();
+    for (segmentIterator it = segments.begin(); it != segments.end(); ++it) {
+      if (it->events.front().time <= time) edited = it;
+      else break;
+    }
+
+    segmentIterator first = edited;
+    if (first != segments.begin()) --first;
+
+    std::vector<timedEvent> events;
+    for (segmentIterator it = first; it != std::next(edited); ++it)
+      events.insert(events.end(), it->events.begin(), it->events.end());
+
+    if (!apply(events)) return false;
+
+    int64_t previousTime = 0, anchor = 0;
+    if (first != segments.begin()) {
+      previousTime = std::prev(first)->lastTime;
+      anchor = std::prev(first)->lastAnchor;
+    }
+
+    segmentIterator next = remove(first, std::next(edited));
+
+    // Keep finalizing until the last new segment can be cut from the next old one.
+
+    while (true) {
+      std::list<segment> pieces;
+      split(events, previousTime, anchor, pieces);
+
+      if (next == segments.end()) {
+        place(next, pieces);
+        return true;
+      }
+
+      if (!pieces.empty() && canCut(pieces.back(), *next)) {
+        segment const& last = pieces.back();
+        int64_t leadingDt = leadingDtAfter(next->events.front().time,
+                                           last.lastTime, last.lastAnchor);
+        int64_t lastTime = last.lastTime, lastAnchor = last.lastAnchor;
+
+        place(next, pieces);
+
+        // The next segment stays valid, but its first dt may have changed.
+
+        if (next->leadingDt != leadingDt) {
+          std::list<segment> renewed;
+          split(next->events, lastTime, lastAnchor, renewed);
+          next = remove(next, std::next(next));
+          place(next, renewed);
+        }
+
+        return true;
+      }
+
+      // The next segment has to be merged : finalize it again,
+      // along with the last new segment.
+
+      if (!pieces.empty()) {
+        events = std::move(pieces.back().events);
+        pieces.pop_back();
+      } else {
+        events.clear();
+      }
+
+      if (!pieces.empty()) {
+        previousTime = pieces.back().lastTime;
+        anchor = pieces.back().lastAnchor;
+      }
+
+      place(next, pieces);
+
+      events.insert(events.end(), next->events.begin(), next->events.end());
+      next = remove(next, std::next(next));
+    }
+  }
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  EditableChronology() :
+    params(ChronologyParams::default_params),
+    whole(ChronologyParams::default_params), pushedTime(0) {}
+  EditableChronology(ChronologyParams::parameters initParams) :
+    params(initParams), whole(initParams), pushedTime(0) {}
+
+  // The segments point into the whole chronology.
+
+  EditableChronology(EditableChronology const&) = delete;
+  EditableChronology& operator=(EditableChronology const&) = delete;
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Build the score as with a Chronology, then finalize it once.
+
+  void pushEvent(int64_t dt, T const& data) {
+    pushedTime += dt;
+    pushedEvents.push_back({pushedTime, data});
+  }
+
+  // Events pushed after a previous finalize() are added at the end of the score.
+
+  void finalize() {
+    if (pushedEvents.empty()) return;
+
+    if (segments.empty()) {
+      std::list<segment> pieces;
+      split(pushedEvents, 0, 0, pieces);
+      place(segments.end(), pieces);
+    } else {
+      for (auto& e : pushedEvents) {
+        timedEvent added = e;
+        edit(added.time, [&added](std::vector<timedEvent>& events) {
+          events.push_back(added);
+          return true;
+        });
+      }
+    }
+
+    pushedEvents.clear();
+  }
+
+  // Insert an event at an absolute time, after the events already at that time.
+
+  void insertEvent(int64_t time, T const& data) {
+    edit(time, [time, &data](std::vector<timedEvent>& events) {
+      auto it = std::upper_bound(events.begin(), events.end(), time,
+        [](int64_t t, timedEvent const& e) { return t < e.time; });
+      events.insert(it, {time, data});
+      return true;
+    });
+  }
+
+  // Remove the first event equal to data at an absolute time.
+  // Returns false if there is none.
+
+  bool removeEvent(int64_t time, T const& data) {
+    return edit(time, [time, &data](std::vector<timedEvent>& events) {
+      for (auto it = events.begin(); it != events.end(); ++it) {
+        if (it->time == time && it->data == data) {
+          events.erase(it);
+          return true;
+        }
+      }
+      return false;
+    });
+  }
+
+  // Replace the first event equal to oldData at an absolute time, in place.
+  // Returns false if there is none.
+
+  bool modifyEvent(int64_t time, T const& oldData, T const& newData) {
+    return edit(time, [time, &oldData, &newData](std::vector<timedEvent>& events) {
+      for (auto& e : events) {
+        if (e.time == time && e.data == oldData) {
+          e.data = newData;
+          return true;
+        }
+      }
+      return false;
+    });
+  }
+
+  std::size_t segmentCount() const { return segments.size(); }
+
+  // The sets of the whole score, identical to those of a Chronology
+  // built from the same events. Copy it to play it (see Renderer::setPartition) :
+  // it is kept up to date by the edits.
+
+  Chronology<T> const& getChronology() const { return whole; }
+
+  void clear() {
+    segments.clear();
+    whole.clear();
+    pushedEvents.clear();
+    pushedTime = 0;
+  }
+};
+
+#endif /* MFP_EDITABLECHRONOLOGY_H */
@@ -13,11 +13,41 @@ namespace Events {
 const int MERGE_AT_BEGINNING=1;
 const int MERGE_AT_END=0;
 
+// Summary of the events of a set, computed once when a chronology is finalized
+// (see ChronologyParams::parameters::precomputeStats) instead of on every combine.
+// Empty by default : event types can specialize it along with computeStats.
+
+template <typename T>
+struct SetStats {};
+
+// Events taking no part in the matching of starts and ends (e.g. pedals and
+// controllers along with notes), carried by the starting set they precede
+// and played with it. Empty by default : event types can specialize it
+// along with appendSideLane.
+
+template <typename T>
+struct SideLane {
+    bool operator==(SideLane const& lane) const { return true; }
+
+    // Calls f with each side event, in order.
+    template <typename F>
+    void forEach(F) const {}
+};
+
 template <typename T>
 struct Set {
     int64_t dt;
     std::vector<T> events;
 
+    // Onset of each event relative to the set's dt, in the same time unit.
+    // Keeps the timing of events clustered under the temporal resolution.
+    // Left empty when all offsets are 0, which is the common case.
+    std::vector<int64_t> offsets;
+
+    SetStats<T> stats;
+
+    SideLane<T> side;
+
     // Used for sorting IN THE CASE OF ABSOLUTE TICKS
     // (No longer in use, but can still come in handy at some point)
 
@@ -49,6 +79,30 @@ enum class correspondOption : int; //define in implementations
 template <typename T>
 bool correspond(T const& e1, T const& e2, correspondOption o) { return false; }
 
+// Event types whose correspondence only depends on a key from a small range
+// can declare it, so that lookups by key use tables indexed directly
+// (see KeyTable) instead of trees and pairwise comparisons.
+// index(e1) == index(e2) must hold exactly when correspond(e1, e2) does,
+// and when correspond(e1, e2, o) does for the options o it covers,
+// for the events inRange : the others are dropped where events enter the
+// library (Chronology::pushEvent, Renderer::combine3Set and pushCommandEvent,
+// CommandCoalescer, IngestionGuard).
+
+template <typename T>
+struct DenseKey {
+    static constexpr bool enabled = false;
+    static constexpr std::size_t size = 0;
+    static constexpr std::size_t index(T const& e) { return 0; }
+    static constexpr bool inRange(T const& e) { return true; }
+    static constexpr bool covers(correspondOption o) { return false; }
+};
+
+// Content hash of an event, used to find identical sets (see InternedChronology).
+// Equal events must have equal hashes : the default is correct, only slow.
+
+template <typename T>
+uint64_t hashEvent(T const& e) { return 0; }
+
 // Determines if compEvent is an ending event matching refEvent
 
 template <typename T>
@@ -71,6 +125,30 @@ bool hasStart(std::vector<T> const& events) {
     return false;
 }
 
+template <typename T>
+int64_t offsetOf(Set<T> const& set, std::size_t index) {
+    return index < set.offsets.size() ? set.offsets[index] : 0;
+}
+
+// Append an event to a set, keeping offsets aligned with events.
+
+template <typename T>
+void appendEvent(Set<T>& set, T const& event, int64_t offset=0) {
+    if (offset != 0 || !set.offsets.empty()) {
+        set.offsets.resize(set.events.size(), 0);
+        set.offsets.push_back(offset);
+    }
+    set.events.push_back(event);
+}
+
+// Erase an event from a set, keeping offsets aligned with events.
+
+template <typename T>
+void eraseEvent(Set<T>& set, std::size_t index) {
+    if (index < set.offsets.size()) set.offsets.erase(set.offsets.begin() + index);
+    set.events.erase(set.events.begin() + index);
+}
+
 template <typename T>
 
 // Merging at the beginning of a vector should be avoided, it is an inefficient operation that requires element shifting
@@ -79,16 +157,60 @@ void mergeSets(Events::Set<T>& greaterSet, std::vector<T> const& mergedSet, int
     typename std::vector<T>::iterator it;
     if(mergePoint==MERGE_AT_BEGINNING) it = greaterSet.events.begin();
     else it = greaterSet.events.end();
+
+    // Merged events carry no timing of their own.
+    if(!greaterSet.offsets.empty()){
+        greaterSet.offsets.resize(greaterSet.events.size(), 0);
+        greaterSet.offsets.insert(
+          mergePoint==MERGE_AT_BEGINNING ? greaterSet.offsets.begin() : greaterSet.offsets.end(),
+          mergedSet.size(),
+          0
+        );
+    }
+
     greaterSet.events.insert(
       it,
       mergedSet.begin(),
       mergedSet.end()
     );
+
+    // The stats no longer describe the events.
+    if(!mergedSet.empty()) greaterSet.stats = SetStats<T>();
 }
 
+// Append the side events of a lane to another.
+
+template <typename T>
+void appendSideLane(SideLane<T>& lane, SideLane<T> const& appended) {}
+
 template <typename T>
 void mergeSets(Events::Set<T>& greaterSet, Events::Set<T> const& mergedSet, int mergePoint=MERGE_AT_END) {
-    mergeSets(greaterSet,mergedSet.events,mergePoint);
+    if(mergePoint==MERGE_AT_BEGINNING){
+        SideLane<T> side = mergedSet.side;
+        appendSideLane(side, greaterSet.side);
+        greaterSet.side = side;
+    } else {
+        appendSideLane(greaterSet.side, mergedSet.side);
+    }
+
+    if(greaterSet.offsets.empty() && mergedSet.offsets.empty()){
+        mergeSets(greaterSet,mergedSet.events,mergePoint);
+        return;
+    }
+
+    std::vector<int64_t> mergedOffsets(mergedSet.offsets);
+    mergedOffsets.resize(mergedSet.events.size(), 0);
+    greaterSet.offsets.resize(greaterSet.events.size(), 0);
+
+    if(mergePoint==MERGE_AT_BEGINNING){
+        greaterSet.events.insert(greaterSet.events.begin(), mergedSet.events.begin(), mergedSet.events.end());
+        greaterSet.offsets.insert(greaterSet.offsets.begin(), mergedOffsets.begin(), mergedOffsets.end());
+    } else {
+        greaterSet.events.insert(greaterSet.events.end(), mergedSet.events.begin(), mergedSet.events.end());
+        greaterSet.offsets.insert(greaterSet.offsets.end(), mergedOffsets.begin(), mergedOffsets.end());
+    }
+
+    if(!mergedSet.events.empty()) greaterSet.stats = SetStats<T>();
 }
 
 template <typename T>
@@ -97,6 +219,9 @@ bool hasStart(Set<T> const& set) { return hasStart<T>(set.events); }
 template <typename T, typename K>
 K keyFromData(T const& e) { K res; return res; }
 
+template <typename T>
+void computeStats(Set<T>& set) {}
+
 }; /* end namespace Events */
 
 #endif /* MFP_EVENT_H */
@@ -0,0 +1,122 @@
+#ifndef MFP_FOOTPRINT_H
+#define MFP_FOOTPRINT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+#include "Events.h"
+
+// Estimates of the heap memory held by the containers of the library,
+// used by the memoryUsage() methods of chronologies, renderers and strategies.
+// The objects themselves (sizeof) are not counted.
+
+// Containers use the default allocator, so sizes are computed from their
+// element counts and capacities, with the per-node overhead of the usual
+// standard library implementations. Allocator headers are not counted.
+
+namespace Footprint {
+
+struct usage {
+  std::size_t used; // Bytes holding live elements
+  std::size_t reserved; // Bytes allocated, including spare capacity
+
+  usage& operator+=(usage const& u) {
+    used += u.used;
+    reserved += u.reserved;
+    return *this;
+  }
+
+  usage operator+(usage const& u) const {
+    usage res = *this;
+    res += u;
+    return res;
+  }
+};
+
+const std::size_t LIST_NODE_OVERHEAD = 2 * sizeof(void*); // previous, next
+const std::size_t MAP_NODE_OVERHEAD = 4 * sizeof(void*); // color, parent, children
+const std::size_t DEQUE_BLOCK_SIZE = 512;
+
+template <typename T>
+usage ofVector(std::vector<T> const& v) {
+  return { v.size() * sizeof(T), v.capacity() * sizeof(T) };
+}
+
+// Side lanes holding events (see Events::SideLane) are counted,
+// the empty default lane has no heap memory.
+
+template <typename L>
+auto ofSideLane(L const& lane, int) -> decltype(ofVector(lane.events)) {
+  return ofVector(lane.events);
+}
+
+template <typename L>
+usage ofSideLane(L const&, long) { return { 0, 0 }; }
+
+// Only the heap memory of the vectors, not of the set itself.
+
+template <typename T>
+usage ofSet(Events::Set<T> const& set) {
+  return ofVector(set.events) + ofVector(set.offsets) + ofSideLane(set.side, 0);
+}
+
+// A list node holds the element itself, so its vectors add up to it.
+
+template <typename T>
+usage ofList(std::list<std::vector<T>> const& l) {
+  usage res = { 0, 0 };
+  for (auto& v : l) {
+    std::size_t node = sizeof(std::vector<T>) + LIST_NODE_OVERHEAD;
+    res += usage{ node, node } + ofVector(v);
+  }
+  return res;
+}
+
+template <typename T>
+usage ofList(std::list<Events::Set<T>> const& l) {
+  usage res = { 0, 0 };
+  for (auto& set : l) {
+    std::size_t node = sizeof(Events::Set<T>) + LIST_NODE_OVERHEAD;
+    res += usage{ node, node } + ofSet(set);
+  }
+  return res;
+}
+
+template <typename K, typename T>
+usage ofMap(std::map<K, std::vector<T>> const& m) {
+  usage res = { 0, 0 };
+  for (auto& entry : m) {
+    std::size_t node = sizeof(entry) + MAP_NODE_OVERHEAD;
+    res += usage{ node, node } + ofVector(entry.second);
+  }
+  return res;
+}
+
+template <typename K, typename V>
+usage ofFlatMap(std::map<K, V> const& m) {
+  std::size_t nodes = m.size() * (sizeof(typename std::map<K, V>::value_type) + MAP_NODE_OVERHEAD);
+  return { nodes, nodes };
+}
+
+// Deques allocate fixed size blocks, plus a map of pointers to them.
+
+template <typename T>
+usage ofDeque(std::deque<std::vector<T>> const& d) {
+  std::size_t perBlock = std::max<std::size_t>(1, DEQUE_BLOCK_SIZE / sizeof(std::vector<T>));
+  std::size_t blocks = (d.size() + perBlock - 1) / perBlock;
+
+  usage res = {
+    d.size() * sizeof(std::vector<T>),
+    blocks * DEQUE_BLOCK_SIZE + blocks * sizeof(void*)
+  };
+
+  for (auto& v : d) res += ofVector(v);
+  return res;
+}
+
+} /* END NAMESPACE Footprint */
+
+#endif /* MFP_FOOTPRINT_H */
@@ -0,0 +1,204 @@
+#ifndef MFP_INTERNEDCHRONOLOGY_H
+#define MFP_INTERNEDCHRONOLOGY_H
+
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+#include "Chronology.h"
+#include "Footprint.h"
+
+// A finalized chronology storing each distinct set only once.
+// Scores repeat themselves a lot (repeats, ostinatos, accompaniment patterns),
+// so most sets are identical to a previous one but for their dt.
+
+// Sets are interned as soon as the underlying Chronology won't modify them
+// anymore, while events are pushed, so the whole score is never held twice.
+// Each occurrence only keeps its dt and a handle to the shared set.
+
+template <typename T>
+class InternedChronology {
+
+public:
+
+  typedef uint32_t handle;
+
+  struct occurrence {
+    int64_t dt;
+    handle set;
+  };
+
+private:
+
+  // ---------------------------------------------------------------------------
+  // ----------------------------PRIVATE FIELDS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  ChronologyParams::parameters params;
+
+  Chronology<T> chronology; // Holds the sets that may still be modified
+
+  std::vector<Events::Set<T>> pool; // Distinct sets, with a dt of 0
+  std::unordered_map<uint64_t, std::vector<handle>> index; // By content hash
+
+  std::vector<occurrence> occurrences;
+
+  // ---------------------------------------------------------------------------
+  // ---------------------------PRIVATE METHODS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  // FNV-1a over the hashes of the events and the offsets.
+
+  static uint64_t hashSet(Events::Set<T> const& set) {
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](uint64_t value) {
+      h ^= value;
+      h *= 1099511628211ULL;
+    };
+
+    mix(set.events.size());
+    for (auto& e : set.events) mix(Events::hashEvent<T>(e));
+    for (auto offset : set.offsets) mix(uint64_t(offset));
+    return h;
+  }
+
+  // Stats are computed from the events, so they are equal along with them.
+  // Side lanes aren't hashed, being empty most of the time.
+
+  static bool sameSet(Events::Set<T> const& s1, Events::Set<T> const& s2) {
+    return s1.events == s2.events && s1.offsets == s2.offsets && s1.side == s2.side;
+  }
+
+  void intern(Events::Set<T>&& set) {
+    int64_t dt = set.dt;
+    set.dt = 0;
+
+    std::vector<handle>& candidates = index[hashSet(set)];
+    for (handle h : candidates) {
+      if (sameSet(pool[h], set)) {
+        occurrences.push_back({ dt, h });
+        return;
+      }
+    }
+
+    handle h = handle(pool.size());
+    set.events.shrink_to_fit();
+    set.offsets.shrink_to_fit();
+    pool.push_back(std::move(set));
+    candidates.push_back(h);
+    occurrences.push_back({ dt, h });
+  }
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  InternedChronology() :
+    params(ChronologyParams::default_params), chronology(params) {}
+  InternedChronology(ChronologyParams::parameters initParams) :
+    params(initParams), chronology(initParams) {}
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  void pushEvent(int64_t dt, T const& data) {
+    chronology.pushEvent(dt, data);
+    while (chronology.hasFinalEventsSet()) intern(chronology.pullFinalEventsSet());
+  }
+
+  // See Chronology::pushSideEvent : side lanes are compared when interning.
+
+  template <typename S>
+  void pushSideEvent(int64_t dt, S const& data) {
+    chronology.pushSideEvent(dt, data);
+  }
+
+  void finalize() {
+    chronology.finalize();
+    while (chronology.hasEvents()) intern(chronology.pullEventsSet());
+  }
+
+  std::size_t size() const { return occurrences.size(); }
+
+  std::size_t uniqueSetCount() const { return pool.size(); }
+
+  occurrence const& at(std::size_t i) const { return occurrences[i]; }
+
+  Events::Set<T> const& getSet(handle h) const { return pool[h]; }
+
+  // Sets in order, each one copied from the pool with the dt of its occurrence.
+
+  class const_iterator {
+    InternedChronology const* source;
+    std::size_t position;
+    mutable Events::Set<T> current; // Reused for every set
+    mutable bool copied;
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Events::Set<T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Events::Set<T> const* pointer;
+    typedef Events::Set<T> const& reference;
+
+    const_iterator(InternedChronology const* s, std::size_t p) :
+      source(s), position(p), copied(false) {}
+
+    reference operator*() const {
+      if (!copied) {
+        occurrence const& o = source->occurrences[position];
+        current = source->pool[o.set];
+        current.dt = o.dt;
+        copied = true;
+      }
+      return current;
+    }
+
+    pointer operator->() const { return &**this; }
+
+    const_iterator& operator++() {
+      ++position;
+      copied = false;
+      return *this;
+    }
+
+    bool operator==(const_iterator const& it) const { return position == it.position; }
+    bool operator!=(const_iterator const& it) const { return position != it.position; }
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, occurrences.size()); }
+
+  // A regular chronology with the same sets, e.g. to set as the partition
+  // of a Renderer.
+
+  Chronology<T> toChronology() const {
+    Chronology<T> res(params);
+    for (auto& set : *this) res.pushFinalizedSet(set);
+    return res;
+  }
+
+  Footprint::usage memoryUsage() const {
+    Footprint::usage res = Footprint::ofVector(pool) + Footprint::ofVector(occurrences);
+    for (auto& set : pool) res += Footprint::ofSet(set);
+
+    for (auto& bucket : index) {
+      std::size_t node = sizeof(bucket) + 2 * sizeof(void*); // next, bucket slot
+      res += Footprint::usage{ node, node } + Footprint::ofVector(bucket.second);
+    }
+
+    auto pending = chronology.memoryUsage();
+    return res + pending.total();
+  }
+
+  void clear() {
+    chronology.clear();
+    pool.clear();
+    index.clear();
+    occurrences.clear();
+  }
+};
+
+#endif /* MFP_INTERNEDCHRONOLOGY_H */
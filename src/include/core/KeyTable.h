@@ -0,0 +1,98 @@
+#ifndef MFP_KEYTABLE_H
+#define MFP_KEYTABLE_H
+
+#include <array>
+#include <bitset>
+#include <map>
+#include <vector>
+#include "Events.h"
+#include "Footprint.h"
+
+// A map from the key of an event (see Events::keyFromData) to a vector of events,
+// as used by the combine engines to bind ends to the key that started them.
+// Event types with a dense key (see Events::DenseKey) get a table indexed
+// directly by key, others a std::map, chosen at compile time.
+// Events must be in the range of their key (see Events::DenseKey::inRange).
+
+template <typename T, typename K, typename V,
+          bool dense = Events::DenseKey<T>::enabled>
+class KeyTable {
+  std::map<K, std::vector<V>> entries;
+
+public:
+  // nullptr if the key of e has no entry.
+
+  std::vector<V>* find(T const& e) {
+    auto it = entries.find(Events::keyFromData<T, K>(e));
+    return it == entries.end() ? nullptr : &it->second;
+  }
+
+  void set(T const& e, std::vector<V> const& value) {
+    entries[Events::keyFromData<T, K>(e)] = value;
+  }
+
+  void erase(T const& e) { entries.erase(Events::keyFromData<T, K>(e)); }
+
+  bool empty() const { return entries.empty(); }
+
+  void clear() { entries.clear(); }
+
+  Footprint::usage memoryUsage() const { return Footprint::ofMap(entries); }
+};
+
+template <typename T, typename K, typename V>
+class KeyTable<T, K, V, true> {
+  static constexpr std::size_t SIZE = Events::DenseKey<T>::size;
+  static constexpr uint16_t NO_SLOT = 0xFFFF;
+  static_assert(SIZE < NO_SLOT, "slots are indexed on 16 bits");
+
+  // Only the keys used get a vector : slots maps each key to its vector,
+  // so that a table costs a few kilobytes until keys are inserted
+  // (e.g. with many sessions, see SessionHost).
+
+  std::array<uint16_t, SIZE> slots;
+  std::vector<std::vector<V>> values; // Grows with the number of keys used
+  std::bitset<SIZE> present;
+
+public:
+  KeyTable() { slots.fill(NO_SLOT); }
+
+  std::vector<V>* find(T const& e) {
+    std::size_t index = Events::DenseKey<T>::index(e);
+    return present[index] ? &values[slots[index]] : nullptr;
+  }
+
+  void set(T const& e, std::vector<V> const& value) {
+    std::size_t index = Events::DenseKey<T>::index(e);
+    if (slots[index] == NO_SLOT) {
+      slots[index] = uint16_t(values.size());
+      values.emplace_back();
+    }
+    values[slots[index]] = value;
+    present.set(index);
+  }
+
+  // The vector is emptied but keeps its slot and capacity for the next press.
+
+  void erase(T const& e) {
+    std::size_t index = Events::DenseKey<T>::index(e);
+    if (!present[index]) return;
+    values[slots[index]].clear();
+    present.reset(index);
+  }
+
+  bool empty() const { return present.none(); }
+
+  void clear() {
+    for (auto& value : values) value.clear();
+    present.reset();
+  }
+
+  Footprint::usage memoryUsage() const {
+    Footprint::usage res = Footprint::ofVector(values);
+    for (auto& value : values) res += Footprint::ofVector(value);
+    return res;
+  }
+};
+
+#endif /* MFP_KEYTABLE_H */
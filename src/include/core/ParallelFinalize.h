@@ -0,0 +1,163 @@
+#ifndef MFP_PARALLELFINALIZE_H
+#define MFP_PARALLELFINALIZE_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "Chronology.h"
+
+// Preprocessing of a whole score on several threads, e.g. for recordings
+// lasting hours. The result is identical to pushing every event to a single
+// Chronology and finalizing it.
+
+// Nothing is carried over by the preprocessing between an ending set and a
+// starting set, once a start has been seen and no incomplete event is left
+// (see EditableChronology, which cuts scores the same way).
+// A first pass over the raw events looks for such boundaries where no note is
+// held, the score is cut there into chunks finalized on their own, and the
+// chunks are appended in order. Should a chunk still end with an incomplete
+// event, it is finalized again along with the next one.
+
+// The range only holds model events : side events (see
+// Chronology::pushSideEvent) aren't supported, a score with controls should
+// be pushed to a single Chronology.
+
+namespace ParallelFinalize {
+
+template <typename T>
+struct chunk {
+  std::size_t first; // Index of the first raw event
+  std::size_t last; // Index past the last raw event
+  int64_t leadingDt; // dt of the first event, as seen by a whole chronology
+  Chronology<T> sets;
+  bool closable; // No incomplete event was left at the end of the chunk
+};
+
+// Push the events of a chunk and finalize it.
+
+template <typename T, typename Iterator>
+void build(chunk<T>& c, Iterator events, std::vector<int64_t> const& times) {
+  for (std::size_t i = c.first; i < c.last; i++) {
+    int64_t dt = i == c.first ? c.leadingDt : times[i] - times[i - 1];
+    c.sets.pushEvent(dt, (events + i)->second);
+  }
+  c.closable = !c.sets.hasIncompleteEvents();
+  c.sets.finalize();
+}
+
+// Iterator is a random access iterator to (dt, event) pairs, as for
+// ChronologyViews::lazySets. A threadCount of 0 uses every core.
+
+template <typename T, typename Iterator>
+Chronology<T> finalize(Iterator first, Iterator last,
+                       ChronologyParams::parameters params,
+                       unsigned int threadCount = 0) {
+  std::size_t count = std::distance(first, last);
+  if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  bool window = params.clustering == ChronologyParams::clusteringOption::WINDOW;
+
+  // First pass : group the events into sets as pushEvent would,
+  // and collect the sets before which the score can be cut.
+
+  std::vector<int64_t> times(count);
+  std::vector<std::size_t> setBegins;
+  std::vector<bool> setHasStart;
+  std::vector<bool> heldAfterSet; // Whether notes are still held after each set
+
+  std::vector<T> held; // Notes started and not yet ended
+  int64_t time = 0, anchor = 0;
+
+  for (std::size_t i = 0; i < count; i++) {
+    T const& e = (first + i)->second;
+    time += (first + i)->first;
+    times[i] = time;
+
+    int64_t distance = window ? time - anchor : time - (i > 0 ? times[i - 1] : 0);
+
+    if (i == 0 || distance > params.temporalResolution) {
+      if (i > 0) heldAfterSet.push_back(!held.empty());
+      setBegins.push_back(i);
+      setHasStart.push_back(false);
+      anchor = time;
+    }
+
+    if (Events::isStart<T>(e)) {
+      setHasStart.back() = true;
+      held.push_back(e);
+    } else {
+      for (auto it = held.begin(); it != held.end(); ++it) {
+        if (Events::correspond<T>(*it, e)) {
+          held.erase(it);
+          break;
+        }
+      }
+    }
+  }
+
+  if (count > 0) heldAfterSet.push_back(!held.empty());
+
+  std::vector<std::size_t> cuts; // Index of the first event of each cut set
+  std::vector<int64_t> cutDts; // dt of that set, as seen by a whole chronology
+  bool hadStart = false;
+
+  for (std::size_t set = 1; set < setBegins.size(); set++) {
+    hadStart = hadStart || setHasStart[set - 1];
+
+    if (hadStart && !setHasStart[set - 1] && setHasStart[set] && !heldAfterSet[set - 1]) {
+      std::size_t i = setBegins[set];
+      cuts.push_back(i);
+      cutDts.push_back(window ? times[i] - times[setBegins[set - 1]] : times[i] - times[i - 1]);
+    }
+  }
+
+  // Keep only as many cuts as needed to give every thread a few chunks.
+
+  std::vector<chunk<T>> chunks;
+  std::size_t target = std::max<std::size_t>(1, count / (4 * threadCount));
+  std::size_t begin = 0;
+  int64_t leadingDt = count > 0 ? times[0] : 0;
+
+  for (std::size_t c = 0; c < cuts.size(); c++) {
+    if (cuts[c] - begin < target) continue;
+    chunks.push_back({ begin, cuts[c], leadingDt, Chronology<T>(params), false });
+    begin = cuts[c];
+    leadingDt = cutDts[c];
+  }
+
+  if (begin < count)
+    chunks.push_back({ begin, count, leadingDt, Chronology<T>(params), false });
+
+  // Finalize the chunks.
+
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadCount && t < chunks.size(); t++) {
+    threads.emplace_back([&chunks, &times, first, t, threadCount]() {
+      for (std::size_t c = t; c < chunks.size(); c += threadCount)
+        build(chunks[c], first, times);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  // Stitch them, merging a chunk with the next while it can't be cut.
+
+  Chronology<T> res(params);
+
+  for (std::size_t c = 0; c < chunks.size(); c++) {
+    chunk<T>& current = chunks[c];
+
+    while (!current.closable && c + 1 < chunks.size()) {
+      current.last = chunks[++c].last;
+      current.sets = Chronology<T>(params);
+      build(current, first, times);
+    }
+
+    res.append(std::move(current.sets));
+  }
+
+  return res;
+}
+
+} /* END NAMESPACE ParallelFinalize */
+
+#endif /* MFP_PARALLELFINALIZE_H */
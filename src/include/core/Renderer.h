@@ -1,10 +1,27 @@
 #ifndef MFP_RENDERER_H
 #define MFP_RENDERER_H
 
+#include <deque>
 #include <iostream>
 #include <list>
 #include <map>
 #include "Chronology.h"
+#include "Diagnostics.h"
+#include "KeyTable.h"
+#include "Tracing.h"
+
+// The combine functions of the 2021 paper, which differ in how the ends
+// of the model intervals are bound to the commands.
+
+enum class CombineMode {
+    COMBINE_0, // Punctual commands : releases are ignored, and the ends of
+    // an interval are played with the next press.
+    COMBINE_1, // The ends are played with the next command, press or release,
+    // following the temporal order of the model.
+    COMBINE_2, // The ends are played by releases in the order of the presses,
+    // whichever key is released.
+    COMBINE_3 // The ends are played by the release of the key that started them.
+};
 
 template <typename Model, typename Command, typename CommandKey>
 class Renderer {
@@ -15,7 +32,8 @@ class Renderer {
 
     Chronology<Model> modelEvents; // A chronology of the model (partition)
 
-    Chronology<Command> commandEvents; // A chronology of the commands
+    Chronology<Command> commandEvents; // A chronology of recorded commands,
+    // only used for offline rendering (see renderCommands)
 
     bool lastEventPulled; // Indicates whether the last event of the model
     // has already been pulled, so as to react differently when asked if any are left.
@@ -27,9 +45,83 @@ class Renderer {
     // (because if ending events have been associated to a key press,
     // that means the preprocessing of the model chronology went wrong.)
 
-    std::map<CommandKey, std::vector<Model>> map3; // A map between a start event
+    KeyTable<Command, CommandKey, Model> map3; // A map between a start event
     // and its correspondent ending.
 
+    CombineMode combineMode; // The engine used by combine() and combineSet()
+
+    std::vector<Model> pendingEnds; // The ends waiting for the next command
+    // in COMBINE_0 and COMBINE_1 mode.
+
+    std::deque<std::vector<Model>> endsQueue; // The ends waiting for a release
+    // in COMBINE_2 mode, oldest first.
+
+    int64_t scoreTime; // Sum of the dts of the pulled sets
+    int64_t lastOnsetTime; // Score time of the last pulled starting set
+    bool hasPulledOnset;
+    int64_t onsetDistance; // Ticks between the last two pulled starting sets
+
+    Events::SideLane<Model> trailingSide; // Side events of the pulled ending sets,
+    // i.e. those following the last start (see Chronology::pushSideEvent),
+    // played with the last release.
+
+    // -------------------------------------------------------------------------
+    // --------------------------PRIVATE METHODS--------------------------------
+    // -------------------------------------------------------------------------
+
+    // Pull the next set of the model, keeping track of the score time.
+
+    Events::Set<Model> pullModelSet() {
+        Events::Set<Model> set = modelEvents.pullEventsSet();
+        scoreTime += set.dt;
+
+        if (Events::hasStart<Model>(set)) {
+            onsetDistance = hasPulledOnset ? scoreTime - lastOnsetTime : 0;
+            lastOnsetTime = scoreTime;
+            hasPulledOnset = true;
+        }
+
+        return set;
+    }
+
+    // Pull the next starting set and the ending set that follows it.
+    // Returns false if the model was empty.
+
+    bool pullInterval(Events::Set<Model>& starts, std::vector<Model>& ends) {
+        if (!modelEvents.hasEvents()) return false;
+
+        starts = pullModelSet();
+        ends.clear();
+
+        // Only the malformed partitions have two starting sets in a row :
+        // the second one is left for the next command.
+
+        if (modelEvents.hasEvents() && !Events::hasStart<Model>(*modelEvents.begin()))
+            ends = pullEndingSet();
+
+        if (!modelEvents.hasEvents()) lastEventPulled = true;
+        return true;
+    }
+
+    // Pull an ending set, keeping its side events for the last release.
+
+    std::vector<Model> pullEndingSet() {
+        Events::Set<Model> set = pullModelSet();
+        Events::appendSideLane(trailingSide, set.side);
+        return std::move(set.events);
+    }
+
+    // Once the model is over and no ends are left to play,
+    // the trailing side events go with the set being played.
+
+    void playTrailingSide(Events::Set<Model>& set) {
+        if (!lastEventPulled || !map3.empty() || !pendingEnds.empty() || !endsQueue.empty())
+            return;
+
+        Events::appendSideLane(set.side, trailingSide);
+        trailingSide = Events::SideLane<Model>();
+    }
+
     // -------------------------------------------------------------------------
 
 public:
@@ -38,33 +130,64 @@ public:
     // ----------------------CONSTRUCTORS/DESTRUCTORS---------------------------
     // -------------------------------------------------------------------------
 
-    Renderer() : lastEventPulled(false), modelEvents(Chronology<Model>()) {}
+    Renderer() : lastEventPulled(false), modelEvents(Chronology<Model>()),
+        commandEvents(ChronologyParams::command_params),
+        combineMode(CombineMode::COMBINE_3), scoreTime(0), lastOnsetTime(0),
+        hasPulledOnset(false), onsetDistance(0) { Diagnostics::init(); }
     Renderer(ChronologyParams::parameters params) :
-        lastEventPulled(false), modelEvents(Chronology<Model>(params)) {}
+        lastEventPulled(false), modelEvents(Chronology<Model>(params)),
+        commandEvents(ChronologyParams::command_params),
+        combineMode(CombineMode::COMBINE_3), scoreTime(0), lastOnsetTime(0),
+        hasPulledOnset(false), onsetDistance(0) { Diagnostics::init(); }
 
     // -------------------------------------------------------------------------
     // ---------------------------PUBLIC METHODS--------------------------------
     // -------------------------------------------------------------------------
 
     // Push a new model event.
-    // For now, command chronologies are not supported, so this is the only push
 
-    virtual void pushEvent(int dt, Model event) {
+    virtual void pushEvent(int64_t dt, Model event) {
         modelEvents.pushEvent(dt, event);
     }
 
-    // This should be private if implemented at all,
-    // since commands will be pushed and pulled live
+    // Push an event of the side lane of the model (see Events::SideLane).
 
-    // void pushCommandEvent(int dt, Command cmd) {
-    //     commandEvents.pushEvent(dt, cmd);
-    // }
+    template <typename Side>
+    void pushSideEvent(int64_t dt, Side const& event) {
+        modelEvents.pushSideEvent(dt, event);
+    }
+
+    // Push several model tracks, merged on absolute time.
+
+    virtual void pushTracks(std::vector<typename Chronology<Model>::trackReader> tracks) {
+        modelEvents.pushTracks(tracks);
+    }
+
+    template <typename Iterator>
+    void pushTracks(std::vector<std::pair<Iterator, Iterator>> const& ranges) {
+        modelEvents.pushTracks(ranges);
+    }
+
+    // Push a recorded command, for offline rendering.
+    // Live commands should be given to combine3 directly instead.
+    // Commands are only grouped by date : they need none of the model preprocessing.
+    // Commands out of the range of their key are dropped (see Events::DenseKey),
+    // an empty set keeping their date.
+
+    virtual void pushCommandEvent(int64_t dt, Command cmd) {
+        if (!Events::DenseKey<Command>::inRange(cmd)) {
+            Diagnostics::warning("command out of range dropped");
+            commandEvents.pushSet({dt, {}, {}, {}, {}});
+            return;
+        }
+        commandEvents.pushSet({dt, {cmd}, {}, {}, {}});
+    }
 
     // Finalize the fixed partition.
 
     virtual void finalize() {
         modelEvents.finalize();
-        //std::cout << "C++ debug : " << std::endl << modelEvents << std::endl;
+        MFP_DEBUG("finalized partition : {} sets", modelEvents.size());
     }
 
     // If the last event isn't pulled, refer to the partition chronology.
@@ -80,26 +203,139 @@ public:
     // Is there any use for this ??
 
     virtual std::vector<Model> pullEvents() {
-        return modelEvents.pullEvents();
+        return pullModelSet().events;
     }
 
     virtual Events::Set<Model> pullEventsSet() {
-        return modelEvents.pullEventsSet();
+        return pullModelSet();
+    }
+
+    // Ticks between the onsets of the last two starting sets pulled,
+    // ending sets included, e.g. to follow the tempo of the player
+    // (see Scheduler::schedule). 0 until two starting sets are pulled.
+
+    int64_t getOnsetDistance() const { return onsetDistance; }
+
+    // Choose the engine used by combine() and combineSet().
+    // The engines don't share their state : switch before performing.
+
+    void setCombineMode(CombineMode mode) { combineMode = mode; }
+
+    CombineMode getCombineMode() const { return combineMode; }
+
+    // Combine a command with the appropriate model events,
+    // using the engine chosen with setCombineMode.
+
+    std::vector<Model> combine(Command cmd) {
+        return combineSet(cmd).events;
+    }
+
+    Events::Set<Model> combineSet(Command cmd) {
+        MFP_TRACE_SCOPE("Renderer::combineSet");
+        switch (combineMode) {
+            case CombineMode::COMBINE_0: return combine0Set(cmd);
+            case CombineMode::COMBINE_1: return combine1Set(cmd);
+            case CombineMode::COMBINE_2: return combine2Set(cmd);
+            default: return combine3Set(cmd);
+        }
     }
 
-    // Combine a command with the appropriate model events.
+    // combine_0 : only presses advance in the model.
+    // Each press plays the ends left by the previous one, then its own starts.
+    // Releases play nothing.
+
+    virtual std::vector<Model> combine0(Command cmd) {
+        return combine0Set(cmd).events;
+    }
+
+    virtual Events::Set<Model> combine0Set(Command cmd) {
+        if (!Events::isStart<Command>(cmd)) return {0, {}, {}, {}, {}};
+
+        Events::Set<Model> set = {0, {}, {}, {}, {}};
+        std::vector<Model> ends;
+
+        if (!pullInterval(set, ends)) {
+            // The model is over : only the last ends remain.
+            set.events.swap(pendingEnds);
+            playTrailingSide(set);
+            return set;
+        }
+
+        Events::mergeSets(set, pendingEnds, Events::MERGE_AT_BEGINNING);
+        pendingEnds.swap(ends);
+        return set;
+    }
+
+    // combine_1 : same as combine_0, except that a release
+    // plays the ends left by the last press right away.
+
+    virtual std::vector<Model> combine1(Command cmd) {
+        return combine1Set(cmd).events;
+    }
+
+    virtual Events::Set<Model> combine1Set(Command cmd) {
+        if (Events::isStart<Command>(cmd)) return combine0Set(cmd);
+
+        Events::Set<Model> set = {0, {}, {}, {}, {}};
+        set.events.swap(pendingEnds);
+        playTrailingSide(set);
+        return set;
+    }
+
+    // combine_2 : each press queues its ends,
+    // and each release plays the oldest ends of the queue.
+
+    virtual std::vector<Model> combine2(Command cmd) {
+        return combine2Set(cmd).events;
+    }
+
+    virtual Events::Set<Model> combine2Set(Command cmd) {
+        Events::Set<Model> set = {0, {}, {}, {}, {}};
+
+        if (Events::isStart<Command>(cmd)) {
+            std::vector<Model> ends;
+            if (pullInterval(set, ends)) endsQueue.push_back(std::move(ends));
+            return set;
+        }
+
+        if (!endsQueue.empty()) {
+            set.events = std::move(endsQueue.front());
+            endsQueue.pop_front();
+        }
+
+        playTrailingSide(set);
+        return set;
+    }
+
+    // combine_3 : the ends are bound to the key that started them.
     // The combineN methods could be invoked from live commands or by pulling
     // the commandEvents chronology.
 
     virtual std::vector<Model> combine3(Command cmd) {
-        CommandKey commandKey = Events::keyFromData<Command, CommandKey>(cmd);
+        return combine3Set(cmd).events;
+    }
+
+    // Same as combine3, but the pulled set is returned whole,
+    // so that the offsets of its events are kept for scheduling.
+    // Events that don't come from the pulled set have no offset.
+
+    virtual Events::Set<Model> combine3Set(Command cmd) {
+        MFP_TRACE_SCOPE("Renderer::combine3Set");
         std::vector<Model> emptyEvents = {};
 
+        // Its key could be that of another command (see Events::DenseKey).
+
+        if (!Events::DenseKey<Command>::inRange(cmd)) {
+            Diagnostics::warning("command out of range dropped");
+            return {0, emptyEvents, {}, {}, {}};
+        }
+
         // If the command is a key press, search for the next event.
 
         if (Events::isStart<Command>(cmd)) {
-            //std::cout << "start command" << std::endl;
-            std::vector<Model> events = modelEvents.pullEvents();
+            MFP_DEBUG("start command");
+            Events::Set<Model> set = pullModelSet();
+            std::vector<Model>& events = set.events;
 
             // If the event set that has been pulled is a starting set
             // (Which should always be the case) :
@@ -112,22 +348,19 @@ public:
                 // is always found right next to the beginning.
 
                 try {
-                    nextEvents = modelEvents.pullEvents();
+                    nextEvents = pullEndingSet();
                     if (Events::hasStart<Model>(nextEvents)) throw nextEvents;
                 } catch (std::vector<Model> nextEvents) {
                     // nextEvents should be an ending set.
-                    std::cout << "ASSOCIATED START IN COMBINE MAP" << std::endl;
+                    // The one blocking path of the rendering thread :
+                    // the process exits, so the error is delivered here
+                    // (lock, formatting, sink) rather than by the application.
+                    Diagnostics::error("associated start in combine map");
+                    Diagnostics::deliver();
                     exit(1);
                 }
 
-                /*std::cout << "C++ debug : " << cmd << " associated with ";
-                if (!nextEvents.empty()) {
-                    for (Model& e : nextEvents) {
-                        std::cout << e << std::endl;
-                    }
-                } else {
-                    std::cout << "no release events" << std::endl;
-                }*/
+                MFP_DEBUG("command associated with {} release events", nextEvents.size());
 
                 // Indicate that the last event has been pulled.
                 if (!modelEvents.hasEvents()) lastEventPulled = true;
@@ -137,45 +370,177 @@ public:
                 // Trigger them, and then register the new ones.
 
 
-                if (map3.find(commandKey) != map3.end()) {
-                    std::vector<Model> extraEvents = map3[commandKey];
-
-                    events.insert(events.end(), extraEvents.begin(), extraEvents.end());
+                if (std::vector<Model>* extraEvents = map3.find(cmd)) {
+                    Events::mergeSets(set, *extraEvents);
                     // Should we rather append them to nextEvents ?
                 }
 
                 // Map the key to this event, so as to bind its release to it.
-                map3[commandKey] = nextEvents;
+                map3.set(cmd, nextEvents);
 
-                return events;
+                return set;
 
             } else { // this should not happen, but the fallback is here
                 orphanedEndings.push_back(events);
                 if (!modelEvents.hasEvents()) lastEventPulled = true;
-                return emptyEvents;
+                return {0, emptyEvents, {}, {}, {}};
             }
         } else { // the key was released, so we look in the map to see what to trigger
 
-            //std::cout << "end command" << std::endl;
+            MFP_DEBUG("end command");
+
+            std::vector<Model>* boundEvents = map3.find(cmd);
 
-            if (map3.find(commandKey) == map3.end() && !lastEventPulled)
+            if (boundEvents == nullptr && !lastEventPulled)
 
-                return emptyEvents;
+                return {0, emptyEvents, {}, {}, {}};
 
-            std::vector<Model> events = map3[commandKey];
+            std::vector<Model> events = boundEvents ? *boundEvents : emptyEvents;
             if (events.empty() && !orphanedEndings.empty()) {
                 events = orphanedEndings.front();
                 orphanedEndings.pop_front();
             }
 
-            map3.erase(commandKey);
+            map3.erase(cmd);
+
+            Events::Set<Model> set = {0, events, {}, {}, {}};
+            playTrailingSide(set);
+            return set;
+        }
+    }
+
+    // Combine all recorded commands with the model at once (the "direct style"
+    // of the 2021 paper), in a single pass over both chronologies.
+    // The result is the same as calling combine3 on each command in turn,
+    // timed by the commands : each set is dated by the command that triggered it.
+    // Neither the partition nor the live combine state are modified,
+    // so this can be called any number of times.
+    // postProcess is called on each result, with the command that triggered it.
+
+    typedef std::function<void(Events::Set<Model>&, Command const&)> postProcessor;
+
+    virtual Chronology<Model> renderCommands(postProcessor postProcess = nullptr) const {
+        Chronology<Model> res;
+
+        KeyTable<Command, CommandKey, Model> ends; // Same role as map3
+        std::list<std::vector<Model>> orphans; // Same role as orphanedEndings
+
+        auto model = modelEvents.begin();
+        Events::SideLane<Model> trailing; // Same role as trailingSide
+        int64_t time = 0, lastOutputTime = 0;
+
+        for (Events::Set<Command> const& commands : commandEvents) {
+            time += commands.dt;
+
+            for (Command const& cmd : commands.events) {
+                Events::Set<Model> set = {0, {}, {}, {}, {}};
+
+                if (Events::isStart<Command>(cmd)) {
+                    if (model == modelEvents.end()) continue;
+
+                    set = *model++;
+
+                    if (Events::hasStart<Model>(set)) {
+                        std::vector<Model> nextEvents;
+
+                        // A following start would mean the partition is malformed :
+                        // leave it for the next command rather than binding it to this key.
+
+                        if (model != modelEvents.end() && !Events::hasStart<Model>(*model)) {
+                            nextEvents = model->events;
+                            Events::appendSideLane(trailing, model->side);
+                            ++model;
+                        }
+
+                        if (std::vector<Model>* extraEvents = ends.find(cmd))
+                            Events::mergeSets(set, *extraEvents);
+
+                        ends.set(cmd, nextEvents);
+                    } else {
+                        orphans.push_back(set.events);
+                        continue;
+                    }
+                } else {
+                    std::vector<Model>* endEvents = ends.find(cmd);
+
+                    if (endEvents == nullptr && model != modelEvents.end()) continue;
+
+                    if (endEvents != nullptr) {
+                        set.events = *endEvents;
+                        ends.erase(cmd);
+                    }
+
+                    if (set.events.empty() && !orphans.empty()) {
+                        set.events = orphans.front();
+                        orphans.pop_front();
+                    }
+
+                    if (model == modelEvents.end() && ends.empty()) {
+                        Events::appendSideLane(set.side, trailing);
+                        trailing = Events::SideLane<Model>();
+                    }
+                }
+
+                if (postProcess) postProcess(set, cmd);
+                if (set.events.empty() && set.side == Events::SideLane<Model>()) continue;
+
+                set.dt = time - lastOutputTime;
+                res.pushSet(set);
+                lastOutputTime = time;
+            }
+        }
+
+        return res;
+    }
+
+    // Heap memory held by the renderer, per component (see Footprint.h).
 
-            return events;
+    struct footprint {
+        typename Chronology<Model>::footprint model;
+        typename Chronology<Command>::footprint commands;
+        Footprint::usage combineState; // The ends waiting to be played, for every engine
+
+        Footprint::usage total() const {
+            return model.total() + commands.total() + combineState;
         }
+    };
+
+    footprint memoryUsage() const {
+        return {
+            modelEvents.memoryUsage(),
+            commandEvents.memoryUsage(),
+            map3.memoryUsage() + Footprint::ofList(orphanedEndings)
+                + Footprint::ofVector(pendingEnds) + Footprint::ofDeque(endsQueue)
+        };
     }
 
+    // Reset the partition, along with the state of every engine.
+
     virtual void clear() {
         modelEvents.clear();
+        lastEventPulled = false;
+        orphanedEndings.clear();
+        map3.clear();
+        pendingEnds.clear();
+        endsQueue.clear();
+        scoreTime = lastOnsetTime = onsetDistance = 0;
+        hasPulledOnset = false;
+        trailingSide = Events::SideLane<Model>();
+    }
+
+    // Forget the recorded commands, keeping the partition.
+
+    virtual void clearCommands() {
+        commandEvents.clear();
+    }
+
+    // Append a finalized partition to the current one, in constant time
+    // (see Chronology::append), e.g. to play a setlist without pause.
+    // The performance goes on from the current position.
+
+    void appendPartition(Chronology<Model>&& nextPartition) {
+        modelEvents.append(std::move(nextPartition));
+        if (modelEvents.hasEvents()) lastEventPulled = false;
     }
 
     // Replace the partition chronology entirely.
@@ -190,6 +555,10 @@ public:
         return modelEvents;
     }
 
+    // Read-only access to the partition, without copying it.
+
+    Chronology<Model> const& peekPartition() const { return modelEvents; }
+
 };
 
 #endif /* MFP_RENDERER_H */
@@ -0,0 +1,131 @@
+#ifndef MFP_RINGBUFFER_H
+#define MFP_RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// A bounded lock-free queue, safe with any number of producers and consumers.
+// Each cell carries a sequence number telling whether it is ready to be
+// written or read for a given lap around the buffer, so that producers and
+// consumers only ever contend on their own position counter.
+// push and pop never block nor allocate : they fail when the queue is full
+// or empty, and the caller decides what to do.
+
+template <typename T>
+class RingBuffer {
+
+  // ---------------------------------------------------------------------------
+  // ------------------------------DATA TYPES-----------------------------------
+  // ---------------------------------------------------------------------------
+
+  struct cell{
+    std::atomic<std::size_t> sequence;
+    T data;
+  };
+
+  // ---------------------------------------------------------------------------
+  // ----------------------------PRIVATE FIELDS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  std::unique_ptr<cell[]> buffer;
+  std::size_t mask; // capacity - 1, the capacity being a power of two
+
+  alignas(64) std::atomic<std::size_t> enqueuePos; // Kept on separate cache lines
+  alignas(64) std::atomic<std::size_t> dequeuePos; // so that producers and
+  // consumers don't invalidate each other's
+
+  // ---------------------------------------------------------------------------
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // The capacity is rounded up to a power of two.
+
+  RingBuffer(std::size_t capacity) : enqueuePos(0), dequeuePos(0) {
+    std::size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    buffer.reset(new cell[size]);
+    mask = size - 1;
+
+    for (std::size_t i = 0; i < size; i++)
+      buffer[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  RingBuffer(RingBuffer const&) = delete;
+  RingBuffer& operator=(RingBuffer const&) = delete;
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  std::size_t capacity() const { return mask + 1; }
+
+  // Returns false if the queue is full.
+
+  template <typename U>
+  bool push(U&& data) {
+    cell* c;
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+      c = &buffer[pos & mask];
+      std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+
+      if (diff == 0) { // The cell is free for this lap : try to claim it
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) { // The cell still holds the data of the previous lap
+        return false;
+      } else { // Another producer claimed it first
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    c->data = std::forward<U>(data);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+
+  bool pop(T& data) {
+    cell* c;
+    std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+      c = &buffer[pos & mask];
+      std::size_t sequence = c->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+
+      if (diff == 0) { // The cell has been written for this lap : try to claim it
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) { // Nothing written yet
+        return false;
+      } else { // Another consumer claimed it first
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    data = std::move(c->data);
+    c->data = T(); // Release what the cell holds (e.g. shared pointers) right away
+    c->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only a hint when other threads are pushing or popping.
+
+  bool empty() const {
+    return enqueuePos.load(std::memory_order_acquire)
+        == dequeuePos.load(std::memory_order_acquire);
+  }
+};
+
+#endif /* MFP_RINGBUFFER_H */
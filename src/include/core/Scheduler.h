@@ -0,0 +1,270 @@
+#ifndef MFP_SCHEDULER_H
+#define MFP_SCHEDULER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "Diagnostics.h"
+#include "Events.h"
+
+// Dispatches the events of a set at their original offsets, scaled to the
+// player's tempo, instead of emitting them all at once.
+
+// Pending events are kept in a hierarchical timer wheel : WHEEL_SIZE slots of
+// slotDuration for the near future, WHEEL_SIZE slots of WHEEL_SIZE slots for
+// the far future, and an overflow list beyond that. Both insertion and
+// dispatch are constant time per event.
+
+template <typename T>
+class Scheduler {
+
+public:
+
+  typedef std::chrono::steady_clock clock;
+
+private:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------------DATA TYPES-----------------------------------
+  // ---------------------------------------------------------------------------
+
+  static const uint64_t WHEEL_BITS = 8;
+  static const uint64_t WHEEL_SIZE = 1 << WHEEL_BITS;
+  static const uint64_t WHEEL_MASK = WHEEL_SIZE - 1;
+
+  struct pendingEvent{
+    uint64_t slot; // absolute index of the slot the event is due in
+    T data;
+  };
+
+  // ---------------------------------------------------------------------------
+  // ----------------------------PRIVATE FIELDS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  clock::duration slotDuration; // Precision of the dispatch
+
+  clock::duration nominalTickDuration; // Duration of a chronology tick
+  // at the tempo of the score
+
+  clock::duration tickDuration; // Duration of a chronology tick
+  // at the tempo of the player, as estimated from the onsets
+
+  bool started; // Whether origin has been set by a first schedule call
+  clock::time_point origin; // Time of slot 0
+  uint64_t currentSlot; // Last slot dispatched
+
+  bool hasLastOnset;
+  clock::time_point lastOnset; // Time of the last scheduled starting set
+
+  std::array<std::vector<pendingEvent>, WHEEL_SIZE> nearWheel;
+  std::array<std::vector<pendingEvent>, WHEEL_SIZE> farWheel;
+  std::vector<pendingEvent> overflow;
+  std::vector<pendingEvent> cascaded; // Scratch space reused when cascading
+
+  std::size_t pendingCount;
+
+  // ---------------------------------------------------------------------------
+  // ---------------------------PRIVATE METHODS---------------------------------
+  // ---------------------------------------------------------------------------
+
+  uint64_t slotOf(clock::time_point t) const {
+    if (t <= origin) return 0;
+    return (t - origin) / slotDuration;
+  }
+
+  // Place an event in the wheel matching its distance to the current slot.
+  // The event has to be due strictly after the current slot.
+
+  void insert(pendingEvent const& e) {
+    if ((e.slot >> WHEEL_BITS) == (currentSlot >> WHEEL_BITS))
+      nearWheel[e.slot & WHEEL_MASK].push_back(e);
+    else if ((e.slot >> 2*WHEEL_BITS) == (currentSlot >> 2*WHEEL_BITS))
+      farWheel[(e.slot >> WHEEL_BITS) & WHEEL_MASK].push_back(e);
+    else
+      overflow.push_back(e);
+  }
+
+  // Redistribute the events of a coarser slot once it becomes current.
+
+  void cascade(std::vector<pendingEvent>& slot) {
+    cascaded.swap(slot);
+    for (auto& e : cascaded) insert(e);
+    cascaded.clear();
+  }
+
+  // Move to the next slot and dispatch the events it holds.
+
+  template <typename Emit>
+  void step(Emit& emit) {
+    currentSlot++;
+
+    if ((currentSlot & WHEEL_MASK) == 0) {
+      if (((currentSlot >> WHEEL_BITS) & WHEEL_MASK) == 0) cascade(overflow);
+      cascade(farWheel[(currentSlot >> WHEEL_BITS) & WHEEL_MASK]);
+    }
+
+    std::vector<pendingEvent>& slot = nearWheel[currentSlot & WHEEL_MASK];
+    for (auto& e : slot) emit(e.data);
+    pendingCount -= slot.size();
+    slot.clear();
+  }
+
+  // Update the tick duration from the time elapsed since the last onset,
+  // distance ticks earlier in the score. The estimate is smoothed and kept within a factor 4 of the nominal tempo,
+  // so that a pause doesn't stretch the next chord.
+
+  void followTempo(int64_t distance, clock::time_point now) {
+    if (hasLastOnset && distance > 0) {
+      clock::duration estimate = (now - lastOnset) / distance;
+      if (estimate < nominalTickDuration / 4) estimate = nominalTickDuration / 4;
+      if (estimate > nominalTickDuration * 4) estimate = nominalTickDuration * 4;
+      tickDuration = (tickDuration + estimate) / 2;
+    }
+
+    lastOnset = now;
+    hasLastOnset = true;
+  }
+
+  // ---------------------------------------------------------------------------
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  Scheduler(clock::duration tick,
+            clock::duration slot = std::chrono::milliseconds(1)) :
+    slotDuration(slot), nominalTickDuration(tick), tickDuration(tick),
+    started(false), currentSlot(0), hasLastOnset(false), pendingCount(0) {
+    Diagnostics::init();
+  }
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Set the duration of a chronology tick at the tempo of the score.
+
+  void setTickDuration(clock::duration tick) {
+    nominalTickDuration = tick;
+    tickDuration = tick;
+  }
+
+  clock::duration getTickDuration() const { return tickDuration; }
+
+  bool empty() const { return pendingCount == 0; }
+
+  // Schedule the events of a set, as returned by combine3Set.
+  // Events without offset are emitted right away, the others are kept
+  // until advance() reaches their due time.
+  // Events still pending from a previous set are emitted first,
+  // so that the order of the score is kept when the player is faster.
+  // onsetDistance is the number of ticks since the previous starting set
+  // (see Renderer::getOnsetDistance), used to follow the tempo of the player ;
+  // the tempo is left unchanged when it is 0.
+  // The side events of the set (see Events::SideLane), which precede its
+  // events in the score, are passed to emitSide right away, before them.
+
+  template <typename Emit, typename EmitSide>
+  void schedule(Events::Set<T> const& set, clock::time_point now, Emit emit,
+                EmitSide emitSide, int64_t onsetDistance) {
+    if (!started) {
+      origin = now;
+      started = true;
+    }
+
+    advance(now, emit);
+    flush(emit);
+
+    set.side.forEach(emitSide);
+
+    if (Events::hasStart<T>(set)) followTempo(onsetDistance, now);
+
+    for (std::size_t i = 0; i < set.events.size(); i++) {
+      int64_t offset = Events::offsetOf(set, i);
+      uint64_t slot = offset > 0 ? slotOf(now + offset * tickDuration) : 0;
+
+      if (slot <= currentSlot) {
+        emit(set.events[i]);
+      } else {
+        insert({slot, set.events[i]});
+        pendingCount++;
+      }
+    }
+  }
+
+  // For sets without side events. Side events given here are dropped,
+  // with a warning (see Diagnostics.h).
+
+  template <typename Emit>
+  void schedule(Events::Set<T> const& set, clock::time_point now, Emit emit,
+                int64_t onsetDistance = 0) {
+    std::size_t dropped = 0;
+    schedule(set, now, emit, [&dropped](auto const&) { dropped++; }, onsetDistance);
+    if (dropped > 0) Diagnostics::warning("{} side events dropped by the scheduler", dropped);
+  }
+
+  // Emit the events due at or before now, in order.
+  // To be called regularly from the output thread, with a monotonic clock.
+
+  template <typename Emit>
+  void advance(clock::time_point now, Emit emit) {
+    if (!started) return;
+
+    uint64_t target = slotOf(now);
+
+    while (currentSlot < target) {
+      if (pendingCount == 0) { // nothing to cascade or dispatch : jump ahead
+        currentSlot = target;
+        break;
+      }
+      step(emit);
+    }
+  }
+
+  // Emit every pending event, in order, without waiting for its due time.
+
+  template <typename Emit>
+  void flush(Emit emit) {
+    if (pendingCount == 0) return;
+
+    // Events sharing a slot always share a container,
+    // so a stable sort keeps their insertion order.
+
+    for (auto& slot : nearWheel) {
+      cascaded.insert(cascaded.end(), slot.begin(), slot.end());
+      slot.clear();
+    }
+    for (auto& slot : farWheel) {
+      cascaded.insert(cascaded.end(), slot.begin(), slot.end());
+      slot.clear();
+    }
+    cascaded.insert(cascaded.end(), overflow.begin(), overflow.end());
+    overflow.clear();
+
+    std::stable_sort(cascaded.begin(), cascaded.end(),
+      [](pendingEvent const& e1, pendingEvent const& e2) {
+        return e1.slot < e2.slot;
+      });
+
+    for (auto& e : cascaded) emit(e.data);
+    cascaded.clear();
+    pendingCount = 0;
+  }
+
+  // Drop every pending event.
+
+  void clear() {
+    for (auto& slot : nearWheel) slot.clear();
+    for (auto& slot : farWheel) slot.clear();
+    overflow.clear();
+    pendingCount = 0;
+    hasLastOnset = false;
+    tickDuration = nominalTickDuration;
+  }
+};
+
+#endif /* MFP_SCHEDULER_H */
@@ -0,0 +1,250 @@
+#ifndef MFP_TRACING_H
+#define MFP_TRACING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Timing of the stages of the rendering pipeline, exported in the trace event
+// format of Chrome (chrome://tracing, Perfetto) to see where the time of each
+// keystroke went.
+
+// Each thread writes complete scopes (name, begin, end) to a ring of its own,
+// so that recording never locks nor allocates. The ring is allocated when the
+// thread calls registerThread(), or else at its first record : a real-time
+// thread should register before it plays. Once a ring is full, the oldest
+// records are overwritten. Rings are kept by clear(), except those of the
+// threads that have ended.
+
+// The hooks of the library (MFP_TRACE_SCOPE) are only compiled with the
+// MFP_ENABLE_TRACING definition (see the CMake option of the same name),
+// and then only record while tracing is enabled at run time.
+
+namespace Tracing {
+
+const int64_t NO_VALUE = INT64_MIN;
+
+struct record {
+  const char* name; // Must outlive the trace, e.g. a string literal
+  int64_t value; // Shown as the argument of the scope, unless NO_VALUE
+  uint64_t begin; // Nanoseconds since the first use of the clock
+  uint64_t end;
+};
+
+struct event : record {
+  std::size_t thread; // Order of the allocation of the ring of the thread
+};
+
+inline uint64_t now() {
+  static const std::chrono::steady_clock::time_point origin =
+    std::chrono::steady_clock::now();
+
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - origin
+  ).count();
+}
+
+// RINGS ///////////////////////////////////////////////////////////////////////
+
+// Written by its thread only. count is published after each record,
+// so that a collecting thread reads complete records, except for those
+// overwritten while it reads them : collect while the traced threads are idle.
+
+struct ring {
+  std::unique_ptr<record[]> records;
+  std::size_t capacity;
+  std::size_t thread;
+  std::atomic<uint64_t> count; // Records written since the last clear
+
+  ring(std::size_t c, std::size_t t) :
+    records(new record[c]), capacity(c), thread(t), count(0) {}
+
+  void push(record const& r) {
+    uint64_t n = count.load(std::memory_order_relaxed);
+    records[n % capacity] = r;
+    count.store(n + 1, std::memory_order_release);
+  }
+};
+
+struct registry {
+  std::mutex mutex; // Only taken to allocate a ring, to clear and to collect
+  std::vector<std::shared_ptr<ring>> rings;
+  std::atomic<bool> enabled;
+  std::atomic<std::size_t> capacity;
+
+  registry() : enabled(false), capacity(4096) {}
+};
+
+inline registry& instance() {
+  static registry r;
+  return r;
+}
+
+// The registry shares the ring with its thread : a ring it holds alone
+// belongs to a thread that has ended.
+
+inline ring& threadRing() {
+  thread_local std::shared_ptr<ring> local;
+
+  if (!local) {
+    registry& r = instance();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::size_t thread = r.rings.empty() ? 0 : r.rings.back()->thread + 1;
+    local = std::make_shared<ring>(r.capacity.load(), thread);
+    r.rings.push_back(local);
+  }
+
+  return *local;
+}
+
+// PUBLIC FUNCTIONS ////////////////////////////////////////////////////////////
+
+inline void enable(bool on = true) {
+  instance().enabled.store(on, std::memory_order_relaxed);
+}
+
+inline bool isEnabled() {
+  return instance().enabled.load(std::memory_order_relaxed);
+}
+
+// Records kept per thread, for the rings allocated after the call,
+// and for the others from the next clear().
+
+inline void setCapacity(std::size_t capacity) {
+  instance().capacity.store(capacity < 1 ? 1 : capacity);
+}
+
+// Allocate the ring of the calling thread now rather than at its first record.
+
+inline void registerThread() { threadRing(); }
+
+inline void push(const char* name, uint64_t begin, uint64_t end,
+                 int64_t value = NO_VALUE) {
+  threadRing().push({ name, value, begin, end });
+}
+
+// Drop every record, and the rings of the threads that have ended.
+// The other rings are emptied, not allocated again unless their capacity
+// changed : call it while the traced threads are idle.
+
+inline void clear() {
+  registry& r = instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::size_t capacity = r.capacity.load();
+  std::vector<std::shared_ptr<ring>> kept;
+
+  for (auto& ring : r.rings) {
+    if (ring.use_count() == 1) continue;
+
+    if (ring->capacity != capacity) {
+      ring->records.reset(new record[capacity]);
+      ring->capacity = capacity;
+    }
+
+    ring->count.store(0, std::memory_order_release);
+    kept.push_back(ring);
+  }
+
+  r.rings = std::move(kept);
+}
+
+// The records of every thread, oldest first for each thread.
+
+inline std::vector<event> collect() {
+  registry& r = instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::vector<event> res;
+
+  for (auto& ring : r.rings) {
+    uint64_t count = ring->count.load(std::memory_order_acquire);
+    uint64_t first = count > ring->capacity ? count - ring->capacity : 0;
+
+    for (uint64_t i = first; i < count; i++) {
+      event e;
+      static_cast<record&>(e) = ring->records[i % ring->capacity];
+      e.thread = ring->thread;
+      res.push_back(e);
+    }
+  }
+
+  return res;
+}
+
+inline void writeMicroseconds(std::ostream& out, uint64_t nanoseconds) {
+  uint64_t fraction = nanoseconds % 1000;
+  out << nanoseconds / 1000 << "."
+      << fraction / 100 << (fraction / 10) % 10 << fraction % 10;
+}
+
+// Complete events ("ph" : "X") with timestamps in microseconds.
+
+inline void writeChromeTrace(std::ostream& out) {
+  std::vector<event> events = collect();
+
+  out << "{\"traceEvents\":[";
+
+  for (std::size_t i = 0; i < events.size(); i++) {
+    event const& e = events[i];
+    if (i > 0) out << ",";
+
+    out << "\n{\"name\":\"";
+    for (const char* c = e.name; *c; c++) {
+      if (*c == '"' || *c == '\\') out << '\\';
+      out << *c;
+    }
+
+    out << "\",\"cat\":\"mfp\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread;
+    out << ",\"ts\":";
+    writeMicroseconds(out, e.begin);
+    out << ",\"dur\":";
+    writeMicroseconds(out, e.end - e.begin);
+
+    if (e.value != NO_VALUE) out << ",\"args\":{\"value\":" << e.value << "}";
+    out << "}";
+  }
+
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+// SCOPES //////////////////////////////////////////////////////////////////////
+
+// Records the time from its construction to its destruction.
+// Costs a single relaxed load while tracing is disabled.
+
+class Scope {
+  const char* name;
+  int64_t value;
+  uint64_t begin;
+  bool active;
+
+public:
+  Scope(const char* n, int64_t v = NO_VALUE) :
+    name(n), value(v), begin(0), active(isEnabled()) {
+    if (active) begin = now();
+  }
+
+  ~Scope() {
+    if (active) push(name, begin, now(), value);
+  }
+
+  Scope(Scope const&) = delete;
+  Scope& operator=(Scope const&) = delete;
+};
+
+} /* END NAMESPACE Tracing */
+
+#define MFP_TRACE_CONCAT_(a, b) a##b
+#define MFP_TRACE_CONCAT(a, b) MFP_TRACE_CONCAT_(a, b)
+
+#ifdef MFP_ENABLE_TRACING
+#define MFP_TRACE_SCOPE(...) \
+  Tracing::Scope MFP_TRACE_CONCAT(mfpTraceScope, __LINE__)(__VA_ARGS__)
+#else
+#define MFP_TRACE_SCOPE(...) do {} while (0)
+#endif
+
+#endif /* MFP_TRACING_H */
@@ -1,8 +1,9 @@
 #ifndef MFP_CHORDVELOCITYMAPPING_H
 #define MFP_CHORDVELOCITYMAPPING_H
 
-// #include <memory>
+#include <memory>
 #include "MFPEvents.h"
+#include "../core/Footprint.h"
 
 namespace ChordVelocityMapping {
 
@@ -16,6 +17,19 @@ public:
     std::vector<noteData>& notes,
     uint8_t cmd_velocity
   ) = 0;
+
+  // Same as above, with the statistics of the notes already known
+  // (see ChronologyParams::parameters::precomputeStats).
+
+  virtual void adjustToCommandVelocity(
+    std::vector<noteData>& notes,
+    uint8_t cmd_velocity,
+    Events::SetStats<noteData> const& stats
+  ) = 0;
+
+  // Heap memory held by the state of the strategy (see Footprint.h).
+
+  virtual Footprint::usage memoryUsage() const { return { 0, 0 }; }
 };
 
 // LIST OF STRATEGY IMPLEMENTATIONS ////////////////////////////////////////////
@@ -0,0 +1,99 @@
+#ifndef MFP_COMMANDCOALESCER_H
+#define MFP_COMMANDCOALESCER_H
+
+#include <array>
+#include <functional>
+#include "MFPRenderer.h"
+
+// Plays the presses arriving within a short window as a single step of the
+// score, so that a chord struck with the fist doesn't skip through several sets.
+
+// The first press of a group opens a window : the following presses are staged
+// until its deadline, then the group is played as one press of its first key,
+// with the loudest velocity of the group (see ChordVelocityMapping).
+// Every key of the group is then an alias of the first one, and the group is
+// released when its last key is.
+
+// Times are given by the caller, in any unit (e.g. milliseconds), and must not
+// decrease. Call poll() from a timer so that a group is played at its deadline
+// even when no other command arrives. Commands out of the range of the tables
+// (see Events::DenseKey) are dropped.
+
+class CommandCoalescer {
+public:
+
+  // Called with the output of each step, in one batch.
+
+  typedef std::function<void(Events::Set<noteData> const&)> outputCallback;
+
+  static constexpr std::size_t MAX_GROUP_SIZE = 16; // A full group is played at once
+
+private:
+
+  static constexpr std::size_t KEY_COUNT = Events::DenseKey<commandData>::size;
+  static constexpr uint16_t NO_LEADER = 0xFFFF;
+
+  MFPRenderer& renderer;
+  outputCallback output;
+  int64_t window;
+  bool useCommandVelocity;
+
+  // The staged group.
+
+  std::array<commandData, MAX_GROUP_SIZE> staged;
+  std::size_t stagedCount;
+  int64_t deadline;
+
+  // For each key, the first key of the group it was played with,
+  // and for each first key, the number of keys of its group still held
+  // and the press it was played with, to be released as it was pressed.
+
+  std::array<uint16_t, KEY_COUNT> leaders;
+  std::array<uint8_t, KEY_COUNT> heldCounts;
+  std::array<commandData, KEY_COUNT> leaderCommands;
+
+  void play(commandData cmd);
+
+  void release(commandData cmd);
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // A window of 0 or less plays each press at once, as combine3Set would.
+
+  CommandCoalescer(MFPRenderer& renderer, outputCallback output,
+                   int64_t window, bool useCommandVelocity = true);
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  void setWindow(int64_t w) { window = w; }
+
+  int64_t getWindow() const { return window; }
+
+  void pushCommand(int64_t time, commandData cmd);
+
+  // Play the staged group if its deadline has passed.
+
+  void poll(int64_t time);
+
+  // Play the staged group now.
+
+  void flush();
+
+  bool hasStagedCommands() const { return stagedCount > 0; }
+
+  // Only meaningful when hasStagedCommands().
+
+  int64_t getDeadline() const { return deadline; }
+
+  // Forget the staged group and the aliases, e.g. after a new partition is set.
+
+  void clear();
+};
+
+#endif /* MFP_COMMANDCOALESCER_H */
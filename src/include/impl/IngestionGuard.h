@@ -0,0 +1,96 @@
+#ifndef MFP_INGESTIONGUARD_H
+#define MFP_INGESTIONGUARD_H
+
+#include <array>
+#include "MFPEvents.h"
+
+// Filters the commands of high rate controllers (drum pads, sensor gloves,
+// MPE devices) before they reach a renderer, so that an abusive device can't
+// advance through the score faster than is musically useful.
+
+// A press is dropped when :
+// - the last accepted press of the same key is less than debounce ago,
+// - the token bucket is empty : each press takes a token, and a token is given
+//   back every refillInterval, up to burst tokens,
+// - the guard is told the output is overloaded (see setOverloaded).
+// Releases are only let through for presses that were, whatever the load,
+// so that no note is left hanging. Commands out of the range of the tables
+// (see Events::DenseKey) are always dropped.
+
+// Every check is a lookup in fixed tables indexed by Events::DenseKey :
+// the cost of a command doesn't depend on the traffic.
+// Times are given by the caller, in any unit, and must not decrease.
+
+class IngestionGuard {
+public:
+
+  struct parameters {
+    int64_t debounce; // 0 to disable
+    int64_t refillInterval; // 0 to disable the rate limit
+    uint32_t burst;
+  };
+
+  static constexpr parameters default_params = { 20, 10, 32 };
+
+  struct counters {
+    uint64_t accepted;
+    uint64_t debounced;
+    uint64_t rateLimited;
+    uint64_t shed; // Dropped while overloaded
+    uint64_t orphanReleases; // Releases of dropped or unknown presses
+    uint64_t outOfRange;
+  };
+
+private:
+
+  static constexpr std::size_t KEY_COUNT = Events::DenseKey<commandData>::size;
+
+  parameters params;
+  bool overloaded;
+
+  std::array<int64_t, KEY_COUNT> lastPresses; // Time of the last accepted press
+  std::array<bool, KEY_COUNT> pressed; // Accepted and not released yet
+
+  uint32_t tokens;
+  int64_t lastRefill;
+
+  counters count;
+
+  void refill(int64_t time);
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  IngestionGuard(parameters p = default_params);
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Whether the command should be passed on to the renderer.
+
+  bool admit(int64_t time, commandData const& cmd);
+
+  // While overloaded, every press is dropped.
+
+  void setOverloaded(bool o) { overloaded = o; }
+
+  bool isOverloaded() const { return overloaded; }
+
+  void setParameters(parameters p);
+
+  parameters getParameters() const { return params; }
+
+  counters getCounters() const { return count; }
+
+  void resetCounters();
+
+  // Forget the pressed keys and refill the bucket, e.g. for a new performance.
+
+  void clear();
+};
+
+#endif /* MFP_INGESTIONGUARD_H */
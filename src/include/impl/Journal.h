@@ -0,0 +1,164 @@
+#ifndef MFP_JOURNAL_H
+#define MFP_JOURNAL_H
+
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MFPEvents.h"
+#include "Replay.h"
+#include "../core/RingBuffer.h"
+
+// An exact record of the commands received by a renderer and of the notes it
+// played, for incident analysis and to replay a session (see Replay).
+
+// Recording only stamps a fixed size record and pushes it to a lock-free
+// queue : a background thread drains the queue into the file. When the queue
+// is full, records are dropped rather than waited for, and a DROPPED record
+// telling how many were lost is written as soon as there is room again.
+
+// File format : a "MFPJ" tag and a version byte, the session (see below),
+// then records of 16 bytes, little endian : time (8 bytes, nanoseconds since
+// the opening of the journal), type, then depending on the type :
+// - COMMAND : pressed, id, velocity, channel
+// - OUTPUT : the number of notes of the batch (2 bytes), its sequence number
+//   (3 bytes) and its number of side events (2 bytes, see Events::SideLane),
+//   then, with the time of the batch, one CONTROL record per side event :
+//   status, data1, data2, zero and the sequence number of the batch (3 bytes),
+//   and one NOTE record per note : on, pitch, velocity, channel and
+//   the sequence number of the batch
+// - DROPPED : the number of records lost (4 bytes)
+// The remaining bytes are zero. Records of other threads may come between
+// the notes of a batch : they are gathered by sequence number.
+
+class Journal {
+public:
+
+  enum class recordType : uint8_t { COMMAND = 1, OUTPUT, NOTE, DROPPED, CONTROL };
+
+  // What a replay needs besides the commands : the partition, found by its
+  // key (see PartitionCache::keyBuilder), and the settings of the renderer.
+
+  struct session {
+    uint64_t partitionKey;
+    ChronologyParams::parameters params;
+    CombineMode combineMode;
+    VoiceStealing::StrategyType voiceStealing;
+    ChordVelocityMapping::StrategyType chordRendering;
+    bool useCommandVelocity;
+  };
+
+  struct record {
+    uint64_t time;
+    recordType type;
+    uint8_t data[7];
+  };
+
+  // A decoded record, notes being gathered with their OUTPUT record.
+
+  struct entry {
+    uint64_t time;
+    recordType type;
+    commandData cmd; // COMMAND only
+    std::vector<noteData> notes; // OUTPUT only
+    std::vector<controlData> controls; // OUTPUT only : the side events of the batch
+    bool complete; // OUTPUT only : false if records of the batch were lost
+    uint32_t dropped; // DROPPED only
+  };
+
+private:
+
+  std::unique_ptr<RingBuffer<record>> queue;
+  std::unique_ptr<std::ostream> file;
+  std::thread writer;
+
+  std::atomic<bool> running;
+  std::atomic<uint32_t> droppedCount; // Dropped since the last DROPPED record
+  std::atomic<uint64_t> droppedTotal;
+  std::atomic<uint64_t> pushedCount;
+  std::atomic<uint64_t> writtenCount;
+  std::atomic<uint32_t> batchCount; // Gives the sequence numbers of the batches
+
+  uint64_t origin; // Steady clock time of the opening, in nanoseconds
+
+  uint64_t now() const;
+
+  void push(record const& r);
+
+  void drain();
+
+  void output(std::vector<noteData> const& notes, std::vector<controlData> const& controls);
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // The capacity of the queue is rounded up to a power of two.
+  // Check isOpen() : nothing is recorded if the file couldn't be created.
+
+  Journal(std::string const& path, session const& s, std::size_t capacity = 1 << 16);
+
+  // Queued records are written before the file is closed.
+
+  ~Journal();
+
+  Journal(Journal const&) = delete;
+  Journal& operator=(Journal const&) = delete;
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  bool isOpen() const { return file != nullptr; }
+
+  // Safe to call from any thread, never block nor allocate.
+
+  void command(commandData const& cmd);
+
+  // Empty batches are recorded too, so that each command of a renderer
+  // can be matched with its output.
+
+  void output(std::vector<noteData> const& notes);
+
+  // Records the side events of the set too, e.g. the output of combine3Set.
+
+  void output(Events::Set<noteData> const& set);
+
+  // Records lost because the queue was full.
+
+  uint64_t dropped() const { return droppedTotal.load(); }
+
+  // Wait until the records pushed so far are written to the file.
+
+  void flush();
+
+  // ---------------------------------------------------------------------------
+  // --------------------------------DECODING-----------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Returns false if the journal is malformed ; entries read so far are kept.
+  // A journal cut short by a crash ends with its last complete record.
+
+  static bool read(std::istream& in, session& s, std::vector<entry>& entries);
+
+  // Set the combine mode and the strategies of the session. The partition is
+  // up to the caller (e.g. PartitionCache::load), as is useCommandVelocity.
+
+  static void configure(MFPRenderer& renderer, session const& s);
+
+  // The commands of a journal, with their delays in nanoseconds.
+
+  static std::vector<Replay::timedCommand> commands(std::vector<entry> const& entries);
+
+  // The outputs of a journal, e.g. as the golden output of Replay::diff
+  // when the journal recorded one output per command.
+  // Returns false if records were lost : the outputs can't be trusted then.
+
+  static bool outputs(std::vector<entry> const& entries, Replay::performance& res);
+};
+
+#endif /* MFP_JOURNAL_H */
@@ -23,11 +23,15 @@ inline std::string convertIdToNoteName(uint8_t id){
 
 // NB : commandKey and noteKey structs are for use as std::map keys
 
+// Channels are MIDI channels, from 0 to 15, for commands as for notes,
+// and ids and pitches are MIDI notes, from 0 to 127 : events out of these
+// ranges are dropped as they enter the library (see Events::DenseKey).
+
 struct commandData {
     bool pressed;
     uint8_t id;
     uint8_t velocity;
-    uint8_t channel;
+    uint8_t channel; // 0-15
 };
 
 inline std::ostream& operator<<(std::ostream& os, struct commandData const &cmd){
@@ -57,7 +61,7 @@ struct noteData {
     bool on;
     uint8_t pitch;
     uint8_t velocity;
-    uint8_t channel;
+    uint8_t channel; // 0-15, see commandData
 
     bool operator==(const noteData& note) const {
         return (
@@ -78,6 +82,19 @@ struct noteData {
     }
 };
 
+// A MIDI message other than a note (control change, program change,
+// pitch bend...), played along with the notes (see Events::SideLane).
+
+struct controlData {
+    uint8_t status; // Type and channel, e.g. 0xB0 | channel for a control change
+    uint8_t data1;
+    uint8_t data2; // Unused by the messages of 2 bytes (program change, channel pressure)
+
+    bool operator==(const controlData& control) const {
+        return status == control.status && data1 == control.data1 && data2 == control.data2;
+    }
+};
+
 inline std::ostream& operator<<(std::ostream& os, struct noteData const &note){
     std::string name = convertIdToNoteName(note.pitch);
     return os << "[ on : " << note.on << " , " <<
@@ -103,6 +120,66 @@ struct noteKey {
 
 namespace Events {
     enum class correspondOption { PITCH_AND_CHANNEL, PITCH_ONLY, NONE };
+
+    // Velocity statistics of a set, used by ChordVelocityMapping :
+    // over its sounding starts (note ons with a non-zero velocity),
+    // and over all of its notes, note offs included.
+
+    template <>
+    struct SetStats<noteData> {
+        bool valid; // false until computed
+        uint16_t count;
+        uint8_t min;
+        uint8_t max;
+        float mean;
+        float allMean;
+        uint8_t allMax;
+    };
+
+    // Controls preceding a start are played with its set.
+
+    template <>
+    struct SideLane<noteData> {
+        std::vector<controlData> events;
+
+        bool operator==(SideLane const& lane) const { return events == lane.events; }
+
+        template <typename F>
+        void forEach(F f) const { for (auto const& e : events) f(e); }
+    };
+
+    // 16 channels * 128 pitches (or ids) : the indices of events out of
+    // these ranges are folded into them, so such events are dropped.
+
+    template <>
+    struct DenseKey<noteData> {
+        static constexpr bool enabled = true;
+        static constexpr std::size_t size = 16 * 128;
+        static constexpr std::size_t index(noteData const& note) {
+            return (note.channel & 0x0F) * 128 + (note.pitch & 0x7F);
+        }
+        static constexpr bool inRange(noteData const& note) {
+            return note.channel < 16 && note.pitch < 128;
+        }
+        static constexpr bool covers(correspondOption o) {
+            return o == correspondOption::PITCH_AND_CHANNEL;
+        }
+    };
+
+    template <>
+    struct DenseKey<commandData> {
+        static constexpr bool enabled = true;
+        static constexpr std::size_t size = 16 * 128;
+        static constexpr std::size_t index(commandData const& cmd) {
+            return (cmd.channel & 0x0F) * 128 + (cmd.id & 0x7F);
+        }
+        static constexpr bool inRange(commandData const& cmd) {
+            return cmd.channel < 16 && cmd.id < 128;
+        }
+        static constexpr bool covers(correspondOption o) {
+            return o == correspondOption::PITCH_AND_CHANNEL;
+        }
+    };
 }
 
 /* * * * * * * * * * * * * specializations for commands * * * * * * * * * * * */
@@ -125,6 +202,12 @@ inline commandKey Events::keyFromData<commandData, commandKey>(commandData const
     return { cmd.id, cmd.channel };
 }
 
+template <>
+inline uint64_t Events::hashEvent<commandData>(commandData const& cmd) {
+    return uint64_t(cmd.pressed) << 24 | uint64_t(cmd.id) << 16 |
+           uint64_t(cmd.velocity) << 8 | cmd.channel;
+}
+
 //* * * * * * * * * * * * * specializations for notes * * * * * * * * * * * * */
 
 template<>
@@ -145,5 +228,58 @@ inline noteKey Events::keyFromData<noteData, noteKey>(noteData const& note) {
     return { note.pitch, note.channel };
 }
 
+template <>
+inline uint64_t Events::hashEvent<noteData>(noteData const& note) {
+    return uint64_t(note.on) << 24 | uint64_t(note.pitch) << 16 |
+           uint64_t(note.velocity) << 8 | note.channel;
+}
+
+inline Events::SetStats<noteData> computeVelocityStats(std::vector<noteData> const& notes) {
+    Events::SetStats<noteData> stats = { true, 0, 127, 0, 0.f, 0.f, 0 };
+    unsigned int sum = 0, allSum = 0;
+    for (auto& note : notes) {
+        allSum += note.velocity;
+        if (note.velocity > stats.allMax) stats.allMax = note.velocity;
+        if (note.on && note.velocity != 0) {
+            stats.count++;
+            sum += note.velocity;
+            if (note.velocity > stats.max) stats.max = note.velocity;
+            if (note.velocity < stats.min) stats.min = note.velocity;
+        }
+    }
+    if (stats.count != 0) stats.mean = static_cast<float>(sum) / stats.count;
+    if (!notes.empty()) stats.allMean = static_cast<float>(allSum) / notes.size();
+    return stats;
+}
+
+template <>
+inline void Events::computeStats<noteData>(Events::Set<noteData>& set) {
+    set.stats = computeVelocityStats(set.events);
+}
+
+template <>
+inline void Events::appendSideLane<noteData>(Events::SideLane<noteData>& lane,
+                                             Events::SideLane<noteData> const& appended) {
+    lane.events.insert(lane.events.end(), appended.events.begin(), appended.events.end());
+}
+
+/* * * * * * * * * * * * * filters for chronology views * * * * * * * * * * * */
+
+struct channelFilter {
+    uint8_t channel;
+
+    bool operator()(noteData const& note) const {
+        return note.channel == channel;
+    }
+};
+
+struct pitchRangeFilter {
+    uint8_t lowest;
+    uint8_t highest;
+
+    bool operator()(noteData const& note) const {
+        return note.pitch >= lowest && note.pitch <= highest;
+    }
+};
 
 #endif /* MFP_MFPEVENTS_H */
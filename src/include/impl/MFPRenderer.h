@@ -4,15 +4,21 @@
 #include "MFPEvents.h"
 #include "VoiceStealing.h"
 #include "ChordVelocityMapping.h"
+#include "NoteTransform.h"
 #include "../core/Renderer.h"
 #include "../core/Chronology.h"
 
 class MFPRenderer {
 private:
+  VoiceStealing::StrategyType stealingType;
   std::shared_ptr<VoiceStealing::Strategy> stealingStrategy;
   std::shared_ptr<ChordVelocityMapping::Strategy> chordStrategy;
   Renderer<noteData, commandData, commandKey> renderer;
 
+  NoteTransform transform; // Applied to every output when transformed is set
+  NoteTransform::keyCheck transformCheck; // The keys of the partition checked so far
+  bool transformed;
+
   void setDefaultStrategies() {
     setVoiceStealingStrategy(
       // VoiceStealing::StrategyType::None
@@ -28,33 +34,119 @@ private:
     );
   }
 
+  // The stats of the set no longer hold once notes are inserted or removed.
+
   void preventVoiceStealing(
-    std::vector<noteData>& notes,
-    commandData cmd
+    Events::Set<noteData>& set,
+    commandData cmd,
+    VoiceStealing::Strategy* stealing
   ) const {
-    if (stealingStrategy.get() == nullptr) return;
-    stealingStrategy->preventVoiceStealing(notes, cmd);
+    if (stealing == nullptr) return;
+    MFP_TRACE_SCOPE("VoiceStealing::preventVoiceStealing");
+    if (stealing->preventVoiceStealing(set.events, cmd)) set.stats.valid = false;
   }
 
   void adjustToCommandVelocity(
-    std::vector<noteData>& notes,
+    Events::Set<noteData>& set,
     uint8_t cmd_velocity
   ) const {
     if (chordStrategy.get() == nullptr) return;
-    chordStrategy->adjustToCommandVelocity(notes, cmd_velocity);
+    MFP_TRACE_SCOPE("ChordVelocityMapping::adjustToCommandVelocity");
+    if (set.stats.valid)
+      chordStrategy->adjustToCommandVelocity(set.events, cmd_velocity, set.stats);
+    else
+      chordStrategy->adjustToCommandVelocity(set.events, cmd_velocity);
+  }
+
+  // Apply the voice stealing and chord velocity strategies to a combined set.
+  // Voice stealing strategies keep track of the sounding notes,
+  // so each rendering needs its own instance.
+
+  void applyStrategies(
+    Events::Set<noteData>& res,
+    commandData cmd,
+    bool useCommandVelocity,
+    VoiceStealing::Strategy* stealing
+  ) const {
+    if (res.offsets.empty()) {
+      preventVoiceStealing(res, cmd, stealing);
+      if (useCommandVelocity) adjustToCommandVelocity(res, cmd.velocity);
+      return;
+    }
+
+    // Voice stealing may insert or remove events, so offsets are carried
+    // over by note rather than by position. Only note ons keep theirs :
+    // endings are always played first.
+
+    std::vector<std::pair<noteKey, int64_t>> onsetOffsets;
+    for (std::size_t i = 0; i < res.events.size(); i++) {
+      if (res.events[i].on) onsetOffsets.push_back({
+        Events::keyFromData<noteData, noteKey>(res.events[i]),
+        res.offsets[i]
+      });
+    }
+
+    preventVoiceStealing(res, cmd, stealing);
+    if (useCommandVelocity) adjustToCommandVelocity(res, cmd.velocity);
+
+    res.offsets.assign(res.events.size(), 0);
+    for (std::size_t i = 0; i < res.events.size(); i++) {
+      if (!res.events[i].on) continue;
+      noteKey key = Events::keyFromData<noteData, noteKey>(res.events[i]);
+      for (auto& onset : onsetOffsets) {
+        if (onset.first == key) {
+          res.offsets[i] = onset.second;
+          break;
+        }
+      }
+    }
+  }
+
+  // Applied last, so that strategies see the notes of the partition.
+
+  void applyTransform(Events::Set<noteData>& res) const {
+    if (!transformed) return;
+    MFP_TRACE_SCOPE("NoteTransform");
+    for (auto& note : res.events) note = transform(note);
+    res.stats.valid = false; // Velocities may have changed
+  }
+
+  // A transform that doesn't suit a new partition is dropped.
+  // Returns false if it was.
+
+  bool keepTransform(bool suits) {
+    if (!transformed || suits) return true;
+    transformed = false;
+    Diagnostics::warning("transform dropped : it would merge notes of the partition");
+    return false;
+  }
+
+  bool checkTransform() {
+    if (!transformed) return true;
+    transformCheck = NoteTransform::keyCheck();
+    return keepTransform(transformCheck.add(transform, renderer.peekPartition()));
+  }
+
+  // Only the appended chronology is checked, against the keys seen before.
+
+  bool checkAppendedTransform(Chronology<noteData> const& nextPartition) {
+    if (!transformed) return true;
+    return keepTransform(transformCheck.add(transform, nextPartition));
   }
 
 public:
 
-  MFPRenderer() : renderer() {
+  MFPRenderer() : renderer(), transformed(false) {
     setDefaultStrategies();
   }
 
-  MFPRenderer(ChronologyParams::parameters params) : renderer(params) {
+  MFPRenderer(ChronologyParams::parameters params) :
+    renderer(params), transformed(false) {
     setDefaultStrategies();
   }
 
   void setVoiceStealingStrategy(VoiceStealing::StrategyType s) {
+    stealingType = s;
     stealingStrategy = VoiceStealing::createStrategy(s);
   }
 
@@ -62,29 +154,155 @@ public:
     chordStrategy = ChordVelocityMapping::createStrategy(s);
   }
 
-  void pushEvent(int dt, noteData event) { renderer.pushEvent(dt, event); }
+  // Play the partition through a transform (see NoteTransform.h),
+  // without preprocessing it again. Returns false and keeps the current one
+  // if the transform would make notes of the partition correspond differently.
+  // Should be set between performances : notes already playing
+  // would be released through the new transform.
+
+  bool setTransform(NoteTransform const& t) {
+    NoteTransform::keyCheck check;
+    if (!check.add(t, renderer.peekPartition())) return false;
+    transform = t;
+    transformCheck = std::move(check);
+    transformed = true;
+    return true;
+  }
+
+  void clearTransform() { transformed = false; }
+
+  bool hasTransform() const { return transformed; }
+
+  void pushEvent(int64_t dt, noteData event) { renderer.pushEvent(dt, event); }
+
+  // Controls are played with the next note on : they are found in the side lane
+  // of the set returned by combine3Set (or combineSet), and left out of combine3.
+
+  void pushSideEvent(int64_t dt, controlData event) { renderer.pushSideEvent(dt, event); }
+
+  void pushTracks(std::vector<Chronology<noteData>::trackReader> tracks) {
+    renderer.pushTracks(tracks);
+  }
+
+  template <typename Iterator>
+  void pushTracks(std::vector<std::pair<Iterator, Iterator>> const& ranges) {
+    renderer.pushTracks(ranges);
+  }
 
-  void finalize() { renderer.finalize(); }
+  void finalize() {
+    renderer.finalize();
+    checkTransform();
+  }
 
   bool hasEvents(bool countLastEvent = true) {
     return renderer.hasEvents(countLastEvent);
   }
 
-  std::vector<noteData> pullEvents() { return renderer.pullEvents(); }
+  std::vector<noteData> pullEvents() { return pullEventsSet().events; }
+
+  Events::Set<noteData> pullEventsSet() {
+    Events::Set<noteData> res = renderer.pullEventsSet();
+    applyTransform(res);
+    return res;
+  }
+
+  // See Renderer::getOnsetDistance, e.g. for Scheduler::schedule.
 
-  Events::Set<noteData> pullEventsSet() { return renderer.pullEventsSet(); }
+  int64_t getOnsetDistance() const { return renderer.getOnsetDistance(); }
 
   std::vector<noteData> combine3(commandData cmd,
                                  bool useCommandVelocity = true) {
-    std::vector<noteData> res = renderer.combine3(cmd);
-    preventVoiceStealing(res, cmd);
-    if (useCommandVelocity) adjustToCommandVelocity(res, cmd.velocity);
+    return combine3Set(cmd, useCommandVelocity).events;
+  }
+
+  void setCombineMode(CombineMode mode) { renderer.setCombineMode(mode); }
+
+  CombineMode getCombineMode() const { return renderer.getCombineMode(); }
+
+  // Same as combine3, with the engine chosen by setCombineMode.
+
+  std::vector<noteData> combine(commandData cmd,
+                                bool useCommandVelocity = true) {
+    return combineSet(cmd, useCommandVelocity).events;
+  }
+
+  Events::Set<noteData> combineSet(commandData cmd,
+                                   bool useCommandVelocity = true) {
+    MFP_TRACE_SCOPE("MFPRenderer::combineSet", cmd.id);
+    Events::Set<noteData> res = renderer.combineSet(cmd);
+    applyStrategies(res, cmd, useCommandVelocity, stealingStrategy.get());
+    applyTransform(res);
+    return res;
+  }
+
+  // Same as combine3, keeping the offsets of the pulled set
+  // so that the result can be fed to a Scheduler.
+
+  Events::Set<noteData> combine3Set(commandData cmd,
+                                    bool useCommandVelocity = true) {
+    MFP_TRACE_SCOPE("MFPRenderer::combine3Set", cmd.id);
+    Events::Set<noteData> res = renderer.combine3Set(cmd);
+    applyStrategies(res, cmd, useCommandVelocity, stealingStrategy.get());
+    applyTransform(res);
     return res;
   }
 
+  // Recorded commands, rendered offline all at once (see Renderer::renderCommands).
+  // Strategies are applied to each result as combine3 would,
+  // without disturbing the state of a live performance.
+
+  void pushCommandEvent(int64_t dt, commandData cmd) { renderer.pushCommandEvent(dt, cmd); }
+
+  Chronology<noteData> renderCommands(bool useCommandVelocity = true) const {
+    std::shared_ptr<VoiceStealing::Strategy> stealing =
+      VoiceStealing::createStrategy(stealingType);
+
+    return renderer.renderCommands(
+      [this, useCommandVelocity, &stealing](Events::Set<noteData>& set,
+                                            commandData const& cmd) {
+        applyStrategies(set, cmd, useCommandVelocity, stealing.get());
+        applyTransform(set);
+      }
+    );
+  }
+
+  void clearCommands() { renderer.clearCommands(); }
+
+  // Heap memory held by the renderer, per component (see Footprint.h).
+
+  struct footprint {
+    Renderer<noteData, commandData, commandKey>::footprint renderer;
+    Footprint::usage stealingStrategy;
+    Footprint::usage chordStrategy;
+
+    Footprint::usage total() const {
+      return renderer.total() + stealingStrategy + chordStrategy;
+    }
+  };
+
+  footprint memoryUsage() const {
+    return {
+      renderer.memoryUsage(),
+      stealingStrategy ? stealingStrategy->memoryUsage() : Footprint::usage{ 0, 0 },
+      chordStrategy ? chordStrategy->memoryUsage() : Footprint::usage{ 0, 0 }
+    };
+  }
+
   void clear() { renderer.clear(); }
 
-  void setPartition(Chronology<noteData> const newPartition){ renderer.setPartition(newPartition); }
+  // Both return false if the transform was dropped, not suiting the new notes
+  // (a warning is also posted, see Diagnostics.h).
+
+  bool setPartition(Chronology<noteData> const newPartition){
+    renderer.setPartition(newPartition);
+    return checkTransform();
+  }
+
+  bool appendPartition(Chronology<noteData>&& nextPartition) {
+    bool kept = checkAppendedTransform(nextPartition);
+    renderer.appendPartition(std::move(nextPartition));
+    return kept;
+  }
 
   Chronology<noteData> getPartition() { return renderer.getPartition(); }
 };
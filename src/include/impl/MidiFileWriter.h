@@ -0,0 +1,90 @@
+#ifndef MFP_MIDIFILEWRITER_H
+#define MFP_MIDIFILEWRITER_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include "MFPEvents.h"
+
+// Writes a rendered performance as a Standard MIDI File (format 0) while it is
+// being played, instead of collecting it for an export at the end.
+// Events are encoded as they arrive, with variable length delta times and
+// running status, into a fixed size buffer flushed to the stream when full,
+// so memory use doesn't grow with the length of the session.
+
+// The length of the track is only known at the end : close() writes it back
+// into the header, so the stream has to be seekable (e.g. a std::ofstream).
+// Errors of the stream are kept, and reported by good() and close().
+
+class MidiFileWriter {
+private:
+
+  static const std::size_t BUFFER_SIZE = 4096;
+
+  std::ostream& out;
+  std::vector<uint8_t> buffer; // Never grows beyond BUFFER_SIZE
+
+  uint16_t division; // Ticks per quarter note
+  uint32_t tempo; // Microseconds per quarter note
+
+  std::streampos trackLengthPos; // Where the length of the track is written
+  uint32_t trackLength; // Bytes written to the track so far
+
+  int64_t lastTick; // Date of the last event written, in ticks
+  uint8_t runningStatus; // 0 when the next event must repeat its status
+
+  bool closed;
+  bool failed; // The stream reported an error : the file is incomplete
+
+  void put(uint8_t byte);
+  void putVariableLength(uint32_t value);
+  void putEvent(int64_t tick, const uint8_t* bytes, std::size_t size);
+  void flush();
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // With the default division and tempo, a tick lasts exactly a millisecond.
+
+  MidiFileWriter(std::ostream& out,
+                 uint16_t division = 480,
+                 uint32_t tempo = 480000);
+
+  // Closes the file if close() hasn't been called.
+
+  ~MidiFileWriter();
+
+  MidiFileWriter(MidiFileWriter const&) = delete;
+  MidiFileWriter& operator=(MidiFileWriter const&) = delete;
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Write the notes rendered at a given time, in milliseconds since the
+  // beginning of the performance (e.g. the result of a combine call).
+  // Times must not decrease ; an earlier time is written as the last one.
+
+  void write(int64_t time, std::vector<noteData> const& notes);
+
+  // Same as above, for a set with offsets (see Scheduler), the offsets
+  // being in chronology ticks of the given duration (e.g. the one of
+  // the Scheduler). The controls of its side lane come first.
+
+  void write(int64_t time, Events::Set<noteData> const& set,
+             std::chrono::duration<double, std::milli> tickDuration);
+
+  // Write the end of the track and its length. Nothing can be written after.
+  // Returns false if the file couldn't be written whole.
+
+  bool close();
+
+  // False once the stream has reported an error.
+
+  bool good() const { return !failed; }
+};
+
+#endif /* MFP_MIDIFILEWRITER_H */
@@ -0,0 +1,132 @@
+#ifndef MFP_NOTETRANSFORM_H
+#define MFP_NOTETRANSFORM_H
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include "MFPEvents.h"
+
+// A transformation of notes (transposition, channel remapping, velocity curve),
+// applied on the fly to the sets pulled from a partition, so that a single
+// preprocessed partition can be played in many variants.
+// A transform is only a few lookup tables : it holds no copy of the partition.
+
+// Preprocessing matches the starts and ends of notes by pitch and channel
+// (see Events::correspond). A transform that gives the same pitch or channel
+// to two different notes of a partition (e.g. a transposition clamped at the
+// edge of the keyboard) would pair them differently than the preprocessing did,
+// so it has to be checked against the partition first (see preservesKeys).
+
+struct NoteTransform {
+  uint8_t pitch[128];
+  uint8_t channel[16]; // Channels above 15, out of range (see noteData), are left unchanged
+  uint8_t velocity[128]; // Only applied to note ons
+
+  static NoteTransform identity() {
+    NoteTransform t;
+    for (int i = 0; i < 128; i++) t.pitch[i] = t.velocity[i] = uint8_t(i);
+    for (int i = 0; i < 16; i++) t.channel[i] = uint8_t(i);
+    return t;
+  }
+
+  // Pitches pushed out of the keyboard are clamped to its edges.
+
+  static NoteTransform transpose(int semitones) {
+    NoteTransform t = identity();
+    for (int i = 0; i < 128; i++)
+      t.pitch[i] = uint8_t(std::min(127, std::max(0, i + semitones)));
+    return t;
+  }
+
+  static NoteTransform remapChannel(uint8_t from, uint8_t to) {
+    NoteTransform t = identity();
+    if (from < 16) t.channel[from] = to;
+    return t;
+  }
+
+  // The curve maps the velocities 1 to 127. Results are clamped to [1, 127]
+  // so that a sounding note never becomes a silent one, and 0 is kept.
+
+  template <typename Curve>
+  static NoteTransform velocityCurve(Curve curve) {
+    NoteTransform t = identity();
+    for (int i = 1; i < 128; i++)
+      t.velocity[i] = uint8_t(std::min(127, std::max(1, int(curve(uint8_t(i))))));
+    return t;
+  }
+
+  // This transform, then the next one.
+
+  NoteTransform then(NoteTransform const& next) const {
+    NoteTransform t;
+    for (int i = 0; i < 128; i++) {
+      t.pitch[i] = next.pitch[pitch[i] & 0x7F];
+      t.velocity[i] = next.velocity[velocity[i] & 0x7F];
+    }
+    for (int i = 0; i < 16; i++)
+      t.channel[i] = channel[i] < 16 ? next.channel[channel[i]] : channel[i];
+    return t;
+  }
+
+  noteData operator()(noteData note) const {
+    note.pitch = pitch[note.pitch & 0x7F];
+    if (note.channel < 16) note.channel = channel[note.channel];
+    if (note.on) note.velocity = velocity[note.velocity & 0x7F];
+    return note;
+  }
+
+  // Whether notes that don't correspond in a range of sets (e.g. a Chronology)
+  // still don't once transformed, both by pitch and channel and by pitch only.
+  // Notes that correspond always still do, since the tables are functions.
+
+  template <typename Range>
+  bool preservesKeys(Range const& sets) const {
+    keyCheck check;
+    return check.add(*this, sets);
+  }
+
+  // The keys seen by preservesKeys, so that a partition growing by appends
+  // is checked one chronology at a time, against the keys seen before.
+
+  // Keys are those of Events::DenseKey, as the preprocessing matches them.
+
+  class keyCheck {
+    typedef Events::DenseKey<noteData> noteIndex;
+
+    std::bitset<noteIndex::size> usedKeys, keyImages;
+    bool usedPitches[128] = {};
+    bool pitchImages[128] = {};
+
+  public:
+
+    // Only meaningful with the same transform every time.
+
+    template <typename Range>
+    bool add(NoteTransform const& t, Range const& sets) {
+      for (auto const& set : sets) {
+        for (auto const& note : set.events) {
+          uint8_t p = note.pitch & 0x7F;
+          std::size_t key = noteIndex::index(note);
+
+          if (!usedPitches[p]) {
+            usedPitches[p] = true;
+            if (pitchImages[t.pitch[p] & 0x7F]) return false;
+            pitchImages[t.pitch[p] & 0x7F] = true;
+          }
+
+          if (!usedKeys[key]) {
+            usedKeys[key] = true;
+            noteData image = t(note);
+            std::size_t imageKey = noteIndex::index(image);
+            if (keyImages[imageKey]) return false;
+            keyImages[imageKey] = true;
+          }
+        }
+      }
+
+      return true;
+    }
+  };
+};
+
+#endif /* MFP_NOTETRANSFORM_H */
@@ -0,0 +1,110 @@
+#ifndef MFP_PARTITIONCACHE_H
+#define MFP_PARTITIONCACHE_H
+
+#include <filesystem>
+#include <string>
+#include "MFPEvents.h"
+#include "../core/Chronology.h"
+
+// A local directory of finalized partitions, so that opening a score again
+// costs a file read instead of a whole preprocessing.
+
+// Partitions are found by a hash of the raw events and of every parameter
+// affecting the preprocessing (see keyBuilder). Files are written to a
+// temporary name, flushed to the disk, then renamed, so a partition is either
+// complete or absent, and carry a checksum checked at each load. Once the
+// directory exceeds its size limit, the least recently used partitions are
+// removed. Temporaries count toward the limit, and those left by a crash
+// are removed when the cache is opened.
+
+class PartitionCache {
+public:
+
+  typedef uint64_t key;
+
+  // Hashes the raw events while they are pushed to a chronology.
+
+  class keyBuilder {
+    uint64_t h;
+
+    void add(uint64_t value, int bytes);
+
+  public:
+    keyBuilder(ChronologyParams::parameters params);
+
+    void add(int64_t dt, noteData const& note);
+
+    // For the controls pushed to the side lane (see Chronology::pushSideEvent).
+
+    void add(int64_t dt, controlData const& control);
+
+    key value() const { return h; }
+  };
+
+private:
+
+  std::filesystem::path directory;
+  std::uintmax_t maxBytes;
+
+  std::filesystem::path pathOf(key k) const;
+
+  // Remove the least recently used partitions until the limit is met.
+
+  void evict();
+
+  // Remove the temporaries no store has written to for a while.
+
+  void sweepTemporaries();
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // The directory is created if needed, and swept of stale temporaries.
+
+  PartitionCache(std::filesystem::path directory,
+                 std::uintmax_t maxBytes = 64 * 1024 * 1024);
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  // Returns false if there is no valid partition for the key,
+  // in which case partition is left unchanged. The parameters should be
+  // those the key was built with.
+
+  bool load(key k, ChronologyParams::parameters params,
+            Chronology<noteData>& partition);
+
+  // Returns false if the partition couldn't be written.
+
+  bool store(key k, Chronology<noteData> const& partition);
+
+  // Load the partition of a range of (dt, event) pairs,
+  // or preprocess it and store it if it isn't cached yet.
+
+  template <typename Iterator>
+  Chronology<noteData> open(Iterator first, Iterator last,
+                            ChronologyParams::parameters params) {
+    keyBuilder builder(params);
+    for (Iterator it = first; it != last; ++it) builder.add(it->first, it->second);
+
+    Chronology<noteData> partition(params);
+    if (load(builder.value(), params, partition)) return partition;
+
+    for (Iterator it = first; it != last; ++it) partition.pushEvent(it->first, it->second);
+    partition.finalize();
+    store(builder.value(), partition);
+    return partition;
+  }
+
+  // Bytes used by the cached partitions, and the temporaries being written.
+
+  std::uintmax_t size() const;
+
+  void clear();
+};
+
+#endif /* MFP_PARTITIONCACHE_H */
@@ -0,0 +1,76 @@
+#ifndef MFP_REPLAY_H
+#define MFP_REPLAY_H
+
+#include <istream>
+#include <ostream>
+#include "MFPRenderer.h"
+
+// Replays recorded command streams against a partition at full speed,
+// e.g. to check that an upgrade of the library doesn't change the output
+// of a corpus of recorded sessions.
+
+// Only one pass is made over the commands, and the output is either hashed
+// or compared to a golden output on the fly, so nothing but the result of the
+// current command is kept.
+
+namespace Replay {
+
+// A command and its delay since the previous one. The unit is up to the source
+// (milliseconds for command logs, ticks for MIDI files) ; it doesn't change
+// the output of a replay.
+
+typedef std::pair<int64_t, commandData> timedCommand;
+
+// The result of each command, in order, as given by getPerformanceResults.
+
+typedef std::vector<std::vector<noteData>> performance;
+
+// COMMAND SOURCES /////////////////////////////////////////////////////////////
+
+// Compact binary command log : a "MFPC" tag and a version byte, then one
+// record per command : delay as a variable length quantity, one byte holding
+// the press flag (high bit) and the channel (low nibble), the id and the velocity.
+
+void writeCommandLog(std::ostream& out, std::vector<timedCommand> const& commands);
+
+// Returns false if the log is malformed ; commands read so far are kept.
+
+bool readCommandLog(std::istream& in, std::vector<timedCommand>& commands);
+
+// Reads the note events of a Standard MIDI File (format 0 or 1) as commands :
+// note ons with a non-zero velocity are presses, other notes are releases.
+// Tracks are merged on time. Other events are skipped.
+// Returns false if the file is malformed.
+
+bool readMidiFileCommands(std::istream& in, std::vector<timedCommand>& commands);
+
+// REPLAYS /////////////////////////////////////////////////////////////////////
+
+// Every replay consumes the partition of the renderer, which should be
+// freshly set (see MFPRenderer::setPartition) with the wanted strategies.
+
+struct mismatch {
+  bool found;
+  std::size_t command; // Index of the first command giving a different result
+  std::vector<noteData> expected;
+  std::vector<noteData> actual;
+};
+
+// FNV-1a hash of the output, matching hash(render(renderer, commands)).
+
+uint64_t hash(MFPRenderer& renderer, std::vector<timedCommand> const& commands);
+
+uint64_t hash(performance const& output);
+
+performance render(MFPRenderer& renderer, std::vector<timedCommand> const& commands);
+
+// Stops at the first mismatch. A golden output with a different number
+// of results mismatches at the first missing or extra one.
+
+mismatch diff(MFPRenderer& renderer,
+              std::vector<timedCommand> const& commands,
+              performance const& golden);
+
+} /* END NAMESPACE Replay */
+
+#endif /* MFP_REPLAY_H */
@@ -0,0 +1,88 @@
+#ifndef MFP_SESSIONHOST_H
+#define MFP_SESSIONHOST_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "MFPRenderer.h"
+
+// Runs many independent MFPRenderer sessions (e.g. one per connected user)
+// in a single process.
+
+// Sessions are spread over shards, each owned by a single worker thread :
+// a session is created, performed and destroyed on the thread of its shard,
+// so sessions never share locks, and all of their allocations are made
+// by the same thread. Commands are routed to the owning shard through a
+// lock-free queue, so that the threads receiving them never wait on a shard.
+
+// Sessions have no memory arena of their own : Chronology, KeyTable and the
+// strategies allocate through the global allocator, not being allocator-aware.
+// Keeping each session on one thread only spares allocator contention where
+// malloc keeps per-thread arenas (e.g. glibc, jemalloc, tcmalloc).
+
+class SessionHost {
+public:
+
+  typedef uint32_t sessionId;
+
+  // Called on the thread of the shard with the result of each command,
+  // with its side events (see MFPRenderer::pushSideEvent).
+
+  typedef std::function<void(sessionId, Events::Set<noteData> const&)> outputCallback;
+
+  // A preprocessed partition, shared by all the sessions created from it.
+  // Each session performs on its own copy.
+
+  typedef std::shared_ptr<Chronology<noteData> const> sharedPartition;
+
+private:
+
+  struct shard;
+
+  std::vector<std::unique_ptr<shard>> shards;
+
+  shard& shardOf(sessionId id) { return *shards[id % shards.size()]; }
+
+public:
+
+  // ---------------------------------------------------------------------------
+  // ------------------------CONSTRUCTORS/DESTRUCTORS---------------------------
+  // ---------------------------------------------------------------------------
+
+  // A shardCount of 0 uses one shard per core.
+  // When pinThreads is true, the thread of each shard is bound to a core
+  // (only on Linux ; ignored elsewhere).
+
+  SessionHost(outputCallback output,
+              std::size_t shardCount = 0,
+              std::size_t queueCapacity = 1024,
+              bool pinThreads = false);
+
+  // Messages already queued are processed before the threads are stopped.
+
+  ~SessionHost();
+
+  SessionHost(SessionHost const&) = delete;
+  SessionHost& operator=(SessionHost const&) = delete;
+
+  // ---------------------------------------------------------------------------
+  // -----------------------------PUBLIC METHODS--------------------------------
+  // ---------------------------------------------------------------------------
+
+  std::size_t getShardCount() const { return shards.size(); }
+
+  // All of the following can be called from any thread.
+  // They return false if the queue of the shard is full,
+  // in which case the message is dropped.
+
+  // Create a session, replacing any session with the same id.
+
+  bool createSession(sessionId id, sharedPartition partition,
+                     CombineMode mode = CombineMode::COMBINE_3);
+
+  bool sendCommand(sessionId id, commandData cmd);
+
+  bool closeSession(sessionId id);
+};
+
+#endif /* MFP_SESSIONHOST_H */
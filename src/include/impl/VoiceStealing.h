@@ -1,7 +1,9 @@
 #ifndef MFP_VOICESTEALING_H
 #define MFP_VOICESTEALING_H
 
+#include <memory>
 #include "MFPEvents.h"
+#include "../core/Footprint.h"
 
 namespace VoiceStealing {
 
@@ -11,12 +13,18 @@ class Strategy {
 public:
   virtual ~Strategy() {}
 
-  virtual void preventVoiceStealing(
+  // Returns true if the notes were changed (note offs inserted or removed).
+
+  virtual bool preventVoiceStealing(
     std::vector<noteData>& notes,
     commandData cmd
   ) = 0;
 
   virtual void reset() = 0;
+
+  // Heap memory held by the state of the strategy (see Footprint.h).
+
+  virtual Footprint::usage memoryUsage() const { return { 0, 0 }; }
 };
 
 // LIST OF STRATEGY IMPLEMENTATIONS ////////////////////////////////////////////
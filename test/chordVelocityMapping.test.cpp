@@ -146,5 +146,107 @@ SCENARIO("mapping the relative note velocities of a chord") {
       }
     }
   }
+
+  GIVEN("velocity statistics precomputed at finalize time") {
+    ChronologyParams::parameters params = ChronologyParams::default_params;
+    params.precomputeStats = true;
+    MFPRenderer precomputed(params);
+
+    auto chord = makeChord({ 20, 64, 100, 127 });
+
+    WHEN("we play the same chord with each strategy") {
+      THEN("the resulting velocities are the same as without precomputation") {
+        for (auto strategy : {
+          ChordVelocityMapping::StrategyType::SameForAll,
+          ChordVelocityMapping::StrategyType::ClippedScaledFromMean,
+          ChordVelocityMapping::StrategyType::AdjustedScaledFromMean,
+          ChordVelocityMapping::StrategyType::ClippedScaledFromMax
+        }) {
+          MFPRenderer computed;
+          computed.setChordRenderingStrategy(strategy);
+          precomputed.setChordRenderingStrategy(strategy);
+
+          feedRenderer(computed, chord);
+          feedRenderer(precomputed, chord);
+
+          auto computedRes = getPerformanceResults(computed, makeChordCommand(90));
+          auto precomputedRes = getPerformanceResults(precomputed, makeChordCommand(90));
+
+          REQUIRE(performanceResultsAreIdentical(computedRes, precomputedRes));
+        }
+      }
+    }
+
+    WHEN("ends are merged into the sets, or note offs inserted by voice stealing") {
+      THEN("the stats are recomputed, and the results stay the same") {
+        // Pressing the same key twice merges the ends of the first press
+        // into the second one, and retriggers the sounding notes.
+        std::vector<commandData> commands = {
+          makeCommand(true, 60, 90),
+          makeCommand(true, 60, 50),
+          makeCommand(false, 60)
+        };
+
+        std::vector<noteEvent> chords = makeChord({ 20, 64, 100 });
+        std::vector<noteEvent> second = makeChord({ 30, 40 });
+        second[0].first = 10;
+        chords.insert(chords.end(), second.begin(), second.end());
+
+        for (auto strategy : {
+          ChordVelocityMapping::StrategyType::ClippedScaledFromMean,
+          ChordVelocityMapping::StrategyType::AdjustedScaledFromMean,
+          ChordVelocityMapping::StrategyType::ClippedScaledFromMax
+        }) {
+          MFPRenderer computed;
+          computed.setChordRenderingStrategy(strategy);
+          precomputed.setChordRenderingStrategy(strategy);
+
+          feedRenderer(computed, chords);
+          feedRenderer(precomputed, chords);
+
+          auto computedRes = getPerformanceResults(computed, commands);
+          auto precomputedRes = getPerformanceResults(precomputed, commands);
+
+          REQUIRE(performanceResultsAreIdentical(computedRes, precomputedRes));
+        }
+      }
+    }
+  }
+
+  GIVEN("a set holding note offs along with its note ons") {
+    const std::vector<noteData> notes = {
+      makeNote(false, 50, 120),
+      makeNote(true, 60, 20),
+      makeNote(true, 64, 64),
+      makeNote(true, 67, 100)
+    };
+
+    THEN("each strategy gives the same result with the stats as without") {
+      for (auto type : {
+        ChordVelocityMapping::StrategyType::SameForAll,
+        ChordVelocityMapping::StrategyType::ClippedScaledFromMean,
+        ChordVelocityMapping::StrategyType::AdjustedScaledFromMean,
+        ChordVelocityMapping::StrategyType::ClippedScaledFromMax
+      }) {
+        auto strategy = ChordVelocityMapping::createStrategy(type);
+        std::vector<noteData> computed = notes, precomputed = notes;
+
+        strategy->adjustToCommandVelocity(computed, 90);
+        strategy->adjustToCommandVelocity(precomputed, 90, computeVelocityStats(notes));
+
+        REQUIRE(computed == precomputed);
+      }
+    }
+
+    THEN("the stats are taken over the sounding starts, and over all notes") {
+      Events::SetStats<noteData> stats = computeVelocityStats(notes);
+      REQUIRE(stats.count == 3);
+      REQUIRE(stats.min == 20);
+      REQUIRE(stats.max == 100);
+      REQUIRE(stats.mean == (20.f + 64 + 100) / 3);
+      REQUIRE(stats.allMax == 120);
+      REQUIRE(stats.allMean == (120.f + 20 + 64 + 100) / 4);
+    }
+  }
 }
 
@@ -0,0 +1,930 @@
+#include <catch2/catch_test_macros.hpp>
+#include "MFPRenderer.h"
+#include "ChronologyViews.h"
+#include "EditableChronology.h"
+#include "InternedChronology.h"
+#include "ParallelFinalize.h"
+#include "./utilities.h"
+
+// UTILITIES ///////////////////////////////////////////////////////////////////
+
+inline std::vector<Events::Set<noteData>> getFinalizedSets(
+  ChronologyParams::parameters params,
+  const std::vector<noteEvent>& events
+) {
+  Chronology<noteData> chronology(params);
+  for (auto& event : events) {
+    chronology.pushEvent(event.first, event.second);
+  }
+  chronology.finalize();
+
+  std::vector<Events::Set<noteData>> res;
+  while (chronology.hasEvents()) {
+    res.push_back(chronology.pullEventsSet());
+  }
+  return res;
+}
+
+// TESTS ///////////////////////////////////////////////////////////////////////
+
+SCENARIO("clustering events with a temporal resolution") {
+
+  // Onsets every 4 ticks : each delta is under the resolution,
+  // but the whole run spans twice of it.
+
+  const std::vector<noteEvent> rolledScore = {
+    { 0, makeNote(true,  60) },
+    { 4, makeNote(true,  62) },
+    { 4, makeNote(true,  64) },
+    { 4, makeNote(true,  65) },
+    { 4, makeNote(true,  67) },
+    { 4, makeNote(true,  69) },
+    { 20, makeNote(false, 60) },
+  };
+
+  ChronologyParams::parameters params = ChronologyParams::no_unmeet;
+  params.temporalResolution = 10;
+
+  GIVEN("DELTA clustering") {
+    params.clustering = ChronologyParams::clusteringOption::DELTA;
+    auto sets = getFinalizedSets(params, rolledScore);
+
+    THEN("the chain of small deltas is merged into a single set") {
+      REQUIRE(sets.size() == 2);
+      REQUIRE(sets[0].events.size() == 6);
+    }
+  }
+
+  GIVEN("WINDOW clustering") {
+    params.clustering = ChronologyParams::clusteringOption::WINDOW;
+    auto sets = getFinalizedSets(params, rolledScore);
+
+    THEN("sets are split once the window of the first onset is exceeded") {
+      REQUIRE(sets.size() == 4);
+      REQUIRE(sets[0].events.size() == 3);
+      REQUIRE(sets[2].events.size() == 3);
+      REQUIRE(sets[2].events[0] == makeNote(true, 65));
+    }
+
+    THEN("set dts are measured between onsets") {
+      REQUIRE(sets[0].dt == 0);
+      REQUIRE(sets[2].dt == 12);
+    }
+  }
+
+  GIVEN("a null resolution") {
+    params.temporalResolution = 0;
+    params.clustering = ChronologyParams::clusteringOption::DELTA;
+    auto deltaSets = getFinalizedSets(params, rolledScore);
+    params.clustering = ChronologyParams::clusteringOption::WINDOW;
+    auto windowSets = getFinalizedSets(params, rolledScore);
+
+    THEN("both modes are identical") {
+      REQUIRE(deltaSets.size() == windowSets.size());
+      for (std::size_t i = 0; i < deltaSets.size(); ++i) {
+        REQUIRE(deltaSets[i].dt == windowSets[i].dt);
+        REQUIRE(deltaSets[i].events == windowSets[i].events);
+      }
+    }
+  }
+}
+
+SCENARIO("merging several tracks into a single chronology") {
+
+  const std::vector<noteEvent> melody = {
+    { 0, makeNote(true,  72) },
+    { 4, makeNote(false, 72) },
+    { 0, makeNote(true,  74) },
+    { 4, makeNote(false, 74) },
+  };
+
+  const std::vector<noteEvent> bass = {
+    { 0, makeNote(true,  48) },
+    { 8, makeNote(false, 48) },
+  };
+
+  const std::vector<noteEvent> inner = {
+    { 2, makeNote(true,  60) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(true,  64) },
+    { 4, makeNote(false, 64) },
+  };
+
+  // The same tracks, merged by hand : simultaneous events are ordered by track.
+
+  const std::vector<noteEvent> merged = {
+    { 0, makeNote(true,  72) },
+    { 0, makeNote(true,  48) },
+    { 2, makeNote(true,  60) },
+    { 2, makeNote(false, 72) },
+    { 0, makeNote(true,  74) },
+    { 0, makeNote(false, 60) },
+    { 0, makeNote(true,  64) },
+    { 4, makeNote(false, 74) },
+    { 0, makeNote(false, 48) },
+    { 0, makeNote(false, 64) },
+  };
+
+  typedef std::vector<noteEvent>::const_iterator trackIterator;
+
+  GIVEN("tracks pushed with pushTracks") {
+    Chronology<noteData> chronology;
+    chronology.pushTracks(std::vector<std::pair<trackIterator, trackIterator>>({
+      { melody.begin(), melody.end() },
+      { bass.begin(),   bass.end()   },
+      { inner.begin(),  inner.end()  }
+    }));
+    chronology.finalize();
+
+    auto expected = getFinalizedSets(ChronologyParams::default_params, merged);
+
+    THEN("the result is the chronology of the merged stream") {
+      REQUIRE(chronology.size() == expected.size());
+      for (auto& set : expected) {
+        auto res = chronology.pullEventsSet();
+        REQUIRE(res.dt == set.dt);
+        REQUIRE(res.events == set.events);
+      }
+    }
+  }
+
+  GIVEN("tracks read from readers, further apart than an int can count") {
+    const int64_t distance = int64_t(1) << 33;
+    Chronology<noteData> chronology;
+
+    auto reader = [](std::vector<std::pair<int64_t, noteData>> events) {
+      std::size_t next = 0;
+      return [events, next](int64_t& dt, noteData& data) mutable {
+        if (next == events.size()) return false;
+        dt = events[next].first;
+        data = events[next++].second;
+        return true;
+      };
+    };
+
+    chronology.pushTracks({
+      reader({ { 0, makeNote(true, 60) }, { 1, makeNote(false, 60) } }),
+      reader({ { distance, makeNote(true, 62) }, { 1, makeNote(false, 62) } })
+    });
+    chronology.finalize();
+
+    THEN("the delays are kept whole") {
+      REQUIRE(chronology.size() == 4);
+      REQUIRE(std::next(chronology.begin(), 2)->dt == distance - 1);
+    }
+  }
+}
+
+SCENARIO("traversing a chronology lazily") {
+
+  const std::vector<noteEvent> score = {
+    { 1, makeNote(true,  40) },
+    { 2, makeNote(true,  50, 100, 2) },
+    { 0, makeNote(false, 40) },
+    { 3, makeNote(false, 50, 100, 2) },
+    { 4, makeNote(true,  80) },
+    { 5, makeNote(true,  20, 100, 2) },
+    { 0, makeNote(false, 80) },
+    { 6, makeNote(false, 20, 100, 2) },
+    { 7, makeNote(true,  20) },
+    { 0, makeNote(true,  40) },
+    { 9, makeNote(false, 20) },
+    { 0, makeNote(false, 40) },
+  };
+
+  // Counts the raw events actually read.
+
+  struct countingIterator {
+    std::vector<noteEvent>::const_iterator it;
+    std::size_t* count;
+
+    noteEvent const* operator->() const { return &*it; }
+    countingIterator& operator++() { ++it; ++*count; return *this; }
+    bool operator==(countingIterator const& i) const { return it == i.it; }
+    bool operator!=(countingIterator const& i) const { return it != i.it; }
+  };
+
+  ChronologyParams::parameters params = ChronologyParams::default_params;
+
+  GIVEN("every parameter set") {
+    for (bool complete : { false, true }) {
+      params.complete = complete;
+      auto expected = getFinalizedSets(params, score);
+
+      std::size_t i = 0;
+      for (auto& set : ChronologyViews::lazySets<noteData>(score.begin(), score.end(), params)) {
+        REQUIRE(i < expected.size());
+        REQUIRE(set.dt == expected[i].dt);
+        REQUIRE(set.events == expected[i].events);
+        i++;
+      }
+
+      THEN("lazy sets are identical to the finalized ones") {
+        REQUIRE(i == expected.size());
+      }
+    }
+  }
+
+  GIVEN("a traversal stopped early") {
+    std::size_t count = 0;
+    auto sets = ChronologyViews::lazySets<noteData>(
+      countingIterator{ score.begin(), &count },
+      countingIterator{ score.end(), &count },
+      params
+    );
+
+    for (auto& set : sets) {
+      REQUIRE(set.events[0] == makeNote(true, 40));
+      break;
+    }
+
+    THEN("the rest of the score is not read") {
+      REQUIRE(count < score.size());
+    }
+  }
+
+  GIVEN("filters and a time limit") {
+    Chronology<noteData> chronology(params);
+    for (auto& event : score) chronology.pushEvent(event.first, event.second);
+    chronology.finalize();
+
+    std::vector<noteData> channel2;
+    for (auto& set : ChronologyViews::filterEvents(chronology, channelFilter{ 2 })) {
+      channel2.insert(channel2.end(), set.events.begin(), set.events.end());
+    }
+
+    THEN("only the events of the channel are seen") {
+      REQUIRE(channel2.size() == 4);
+      for (auto& note : channel2) REQUIRE(note.channel == 2);
+    }
+
+    std::size_t count = 0;
+    auto preview = ChronologyViews::untilTime(
+      ChronologyViews::filterEvents(
+        ChronologyViews::lazySets<noteData>(score.begin(), score.end(), params),
+        pitchRangeFilter{ 30, 60 }
+      ),
+      10
+    );
+
+    for (auto& set : preview) {
+      for (auto& note : set.events) REQUIRE(note.pitch >= 30);
+      count++;
+    }
+
+    THEN("the traversal stops at the time limit") {
+      REQUIRE(count > 0);
+      REQUIRE(count < chronology.size());
+    }
+
+    THEN("the chronology is left untouched") {
+      REQUIRE(chronology.size() == getFinalizedSets(params, score).size());
+    }
+  }
+}
+
+SCENARIO("accounting the memory of a chronology") {
+  std::vector<noteEvent> score;
+  for (uint8_t i = 0; i < 50; i++) {
+    score.push_back({ 1, makeNote(true,  40 + i) });
+    score.push_back({ 1, makeNote(false, 40 + i) });
+  }
+
+  MFPRenderer renderer;
+  feedRenderer(renderer, score);
+
+  MFPRenderer::footprint before = renderer.memoryUsage();
+
+  THEN("the sets of the partition are accounted for") {
+    std::size_t minimum = 100 * sizeof(noteData) + 100 * sizeof(Events::Set<noteData>);
+    REQUIRE(before.renderer.model.fifo.used >= minimum);
+    REQUIRE(before.total().used <= before.total().reserved);
+  }
+
+  WHEN("keys are held") {
+    renderer.combine3(makeCommand(true, 60));
+    renderer.combine3(makeCommand(true, 61));
+
+    MFPRenderer::footprint held = renderer.memoryUsage();
+
+    THEN("the partition shrinks and the combine state grows") {
+      REQUIRE(held.renderer.model.fifo.used < before.renderer.model.fifo.used);
+      REQUIRE(held.renderer.combineState.used > before.renderer.combineState.used);
+      REQUIRE(held.stealingStrategy.used == 0); // Its table lives inside the strategy
+    }
+  }
+}
+
+SCENARIO("concatenating finalized chronologies") {
+  const std::vector<noteEvent> firstPiece = {
+    { 0, makeNote(true,  60) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) }
+  };
+
+  const std::vector<noteEvent> secondPiece = {
+    { 0, makeNote(true,  70) },
+    { 0, makeNote(true,  74) },
+    { 3, makeNote(false, 70) },
+    { 0, makeNote(false, 74) }
+  };
+
+  auto finalized = [](const std::vector<noteEvent>& score) {
+    Chronology<noteData> c;
+    for (auto& event : score) c.pushEvent(event.first, event.second);
+    c.finalize();
+    return c;
+  };
+
+  auto alternates = [](Chronology<noteData> const& c) {
+    bool start = true;
+    for (auto& set : c) {
+      if (Events::hasStart<noteData>(set) != start) return false;
+      start = !start;
+    }
+    return start; // the last set is an ending
+  };
+
+  GIVEN("two pieces") {
+    Chronology<noteData> setlist = finalized(firstPiece);
+    Chronology<noteData> next = finalized(secondPiece);
+    std::size_t expectedSize = setlist.size() + next.size();
+
+    setlist.append(std::move(next));
+
+    THEN("the sets of the second piece are moved after the first one") {
+      REQUIRE(setlist.size() == expectedSize);
+      REQUIRE(next.size() == 0);
+      REQUIRE(alternates(setlist));
+    }
+  }
+
+  GIVEN("a piece beginning with endings") {
+    Chronology<noteData> setlist = finalized(firstPiece);
+    Chronology<noteData> next = finalized(secondPiece);
+    next.pullEventsSet(); // only the endings are left
+
+    std::size_t expectedSize = setlist.size() + next.size() - 1;
+    int64_t expectedDt = std::prev(setlist.end())->dt + next.begin()->dt;
+
+    setlist.append(std::move(next));
+
+    THEN("its endings are merged with the last endings of the first piece") {
+      REQUIRE(setlist.size() == expectedSize);
+      REQUIRE(alternates(setlist));
+    }
+
+    THEN("the delay of its endings is kept") {
+      REQUIRE(expectedDt == 5);
+      REQUIRE(std::prev(setlist.end())->dt == expectedDt);
+    }
+  }
+
+  GIVEN("a renderer playing the first piece") {
+    MFPRenderer renderer, reference;
+    feedRenderer(renderer, firstPiece);
+
+    std::vector<commandData> commands;
+    for (uint8_t key = 60; key < 64; key++) {
+      commands.push_back(makeCommand(true,  key));
+      commands.push_back(makeCommand(false, key));
+    }
+
+    auto first = getPerformanceResults(
+      renderer, std::vector<commandData>(commands.begin(), commands.begin() + 2)
+    );
+    renderer.appendPartition(finalized(secondPiece));
+    auto rest = getPerformanceResults(
+      renderer, std::vector<commandData>(commands.begin() + 2, commands.end())
+    );
+    first.insert(first.end(), rest.begin(), rest.end());
+
+    Chronology<noteData> whole = finalized(firstPiece);
+    whole.append(finalized(secondPiece));
+    reference.setPartition(whole);
+    auto expected = getPerformanceResults(reference, commands);
+
+    THEN("appending while playing gives the same performance") {
+      REQUIRE(performanceResultsAreIdentical(first, expected));
+    }
+  }
+}
+
+SCENARIO("editing a finalized chronology") {
+
+  // A score of overlapping notes, from a fixed pseudo-random sequence.
+
+  uint32_t seed = 12345;
+  auto next = [&seed](uint32_t range) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+  };
+
+  std::vector<EditableChronology<noteData>::timedEvent> score;
+  int64_t time = 0;
+  for (int i = 0; i < 200; i++) {
+    time += next(4) * 5;
+    uint8_t pitch = 50 + next(12);
+    score.push_back({ time, makeNote(true, pitch) });
+    score.push_back({ time + 5 + next(3) * 5, makeNote(false, pitch) });
+  }
+  std::stable_sort(score.begin(), score.end(),
+    [](EditableChronology<noteData>::timedEvent const& e1,
+       EditableChronology<noteData>::timedEvent const& e2) {
+      return e1.time < e2.time;
+    });
+
+  // The reference : a chronology built from scratch.
+
+  auto rebuilt = [](ChronologyParams::parameters params,
+                    std::vector<EditableChronology<noteData>::timedEvent> const& events) {
+    Chronology<noteData> c(params);
+    int64_t last = 0;
+    for (auto& e : events) {
+      c.pushEvent(e.time - last, e.data);
+      last = e.time;
+    }
+    c.finalize();
+    return c;
+  };
+
+  auto identical = [](Chronology<noteData> const& c1, Chronology<noteData> const& c2) {
+    if (c1.size() != c2.size()) return false;
+    auto it = c2.begin();
+    for (auto& set : c1) {
+      if (set.dt != it->dt || set.events != it->events || set.offsets != it->offsets)
+        return false;
+      ++it;
+    }
+    return true;
+  };
+
+  ChronologyParams::parameters params = ChronologyParams::default_params;
+
+  SECTION("unmeet") {}
+  SECTION("unmeet and complete") { params.complete = true; }
+  SECTION("window clustering") {
+    params.temporalResolution = 5;
+    params.clustering = ChronologyParams::clusteringOption::WINDOW;
+  }
+
+  EditableChronology<noteData> editable(params);
+  int64_t last = 0;
+  for (auto& e : score) {
+    editable.pushEvent(e.time - last, e.data);
+    last = e.time;
+  }
+  editable.finalize();
+
+  auto events = score;
+
+  THEN("the score is split in segments giving the same sets") {
+    REQUIRE(editable.segmentCount() > 1);
+    REQUIRE(identical(editable.getChronology(), rebuilt(params, events)));
+  }
+
+  THEN("an edit leaves the sets of the segments before it untouched") {
+    std::vector<Events::Set<noteData> const*> before;
+    for (auto& set : editable.getChronology()) before.push_back(&set);
+
+    auto e = events.back();
+    noteData modified = e.data;
+    modified.velocity = 1;
+    REQUIRE(editable.modifyEvent(e.time, e.data, modified));
+    std::find_if(events.begin(), events.end(),
+      [&e](EditableChronology<noteData>::timedEvent const& other) {
+        return other.time == e.time && other.data == e.data;
+      })->data = modified;
+
+    REQUIRE(identical(editable.getChronology(), rebuilt(params, events)));
+
+    // Neither copied nor moved : the same sets, at the same addresses.
+
+    std::size_t kept = 0;
+    for (auto& set : editable.getChronology()) {
+      if (kept == before.size() || &set != before[kept]) break;
+      kept++;
+    }
+
+    REQUIRE(kept >= before.size() / 2);
+    REQUIRE(kept < before.size());
+  }
+
+  WHEN("notes are inserted, removed and modified") {
+    for (int edit = 0; edit < 60; edit++) {
+      std::size_t index = next(events.size());
+      auto e = events[index];
+
+      switch (edit % 3) {
+        case 0: { // insert a short note
+          uint8_t pitch = 40 + next(40);
+          editable.insertEvent(e.time, makeNote(true, pitch));
+          editable.insertEvent(e.time + 5, makeNote(false, pitch));
+
+          auto after = [&events](int64_t t) {
+            return std::upper_bound(events.begin(), events.end(), t,
+              [](int64_t t, EditableChronology<noteData>::timedEvent const& e) {
+                return t < e.time;
+              });
+          };
+          events.insert(after(e.time), { e.time, makeNote(true, pitch) });
+          events.insert(after(e.time + 5), { e.time + 5, makeNote(false, pitch) });
+          break;
+        }
+        case 1: { // remove an event
+          REQUIRE(editable.removeEvent(e.time, e.data));
+          auto it = std::find_if(events.begin(), events.end(),
+            [&e](EditableChronology<noteData>::timedEvent const& other) {
+              return other.time == e.time && other.data == e.data;
+            });
+          events.erase(it);
+          break;
+        }
+        case 2: { // change the velocity of an event
+          noteData modified = e.data;
+          modified.velocity = 1 + next(126);
+          REQUIRE(editable.modifyEvent(e.time, e.data, modified));
+          auto it = std::find_if(events.begin(), events.end(),
+            [&e](EditableChronology<noteData>::timedEvent const& other) {
+              return other.time == e.time && other.data == e.data;
+            });
+          it->data = modified;
+          break;
+        }
+      }
+
+      REQUIRE(identical(editable.getChronology(), rebuilt(params, events)));
+    }
+  }
+}
+
+SCENARIO("interning repeated sets") {
+
+  // An accompaniment pattern played 16 times, under a varying melody.
+
+  std::vector<noteEvent> score;
+  for (int bar = 0; bar < 16; bar++) {
+    uint8_t melody = 72 + bar % 5;
+    score.push_back({ 10, makeNote(true,  48) });
+    score.push_back({ 0,  makeNote(true,  melody) });
+    score.push_back({ 10, makeNote(false, 48) });
+    for (uint8_t pitch : { 55, 52, 55 }) {
+      score.push_back({ 10, makeNote(true,  pitch) });
+      score.push_back({ 10, makeNote(false, pitch) });
+    }
+    score.push_back({ 0,  makeNote(false, melody) });
+  }
+
+  Chronology<noteData> regular;
+  InternedChronology<noteData> interned;
+
+  for (auto& event : score) {
+    regular.pushEvent(event.first, event.second);
+    interned.pushEvent(event.first, event.second);
+  }
+  regular.finalize();
+  interned.finalize();
+
+  THEN("the sets are the same, with their own dt") {
+    REQUIRE(interned.size() == regular.size());
+
+    auto it = regular.begin();
+    for (auto& set : interned) {
+      REQUIRE(set.dt == it->dt);
+      REQUIRE(set.events == it->events);
+      REQUIRE(set.offsets == it->offsets);
+      ++it;
+    }
+
+    Chronology<noteData> expanded = interned.toChronology();
+    REQUIRE(expanded.size() == regular.size());
+  }
+
+  THEN("repeated sets are stored once") {
+    REQUIRE(interned.uniqueSetCount() < interned.size() / 3);
+    REQUIRE(interned.memoryUsage().used < regular.memoryUsage().total().used);
+  }
+}
+
+SCENARIO("finalizing a long score in parallel") {
+
+  // Phrases of overlapping notes separated by rests,
+  // from a fixed pseudo-random sequence.
+
+  uint32_t seed = 54321;
+  auto next = [&seed](uint32_t range) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+  };
+
+  std::vector<std::pair<int64_t, noteData>> timed;
+  int64_t time = 0;
+  for (int i = 0; i < 3000; i++) {
+    time += next(4) * 5 + (next(8) == 0 ? 40 : 0);
+    uint8_t pitch = 50 + next(12);
+    timed.push_back({ time, makeNote(true, pitch) });
+    timed.push_back({ time + 5 + next(3) * 5, makeNote(false, pitch) });
+  }
+  std::stable_sort(timed.begin(), timed.end(),
+    [](std::pair<int64_t, noteData> const& e1, std::pair<int64_t, noteData> const& e2) {
+      return e1.first < e2.first;
+    });
+
+  std::vector<std::pair<int, noteData>> score;
+  int64_t last = 0;
+  for (auto& e : timed) {
+    score.push_back({ int(e.first - last), e.second });
+    last = e.first;
+  }
+
+  ChronologyParams::parameters params = ChronologyParams::default_params;
+
+  SECTION("unmeet") {}
+  SECTION("unmeet and complete") { params.complete = true; }
+  SECTION("no unmeet") { params = ChronologyParams::no_unmeet; }
+  SECTION("window clustering") {
+    params.temporalResolution = 5;
+    params.clustering = ChronologyParams::clusteringOption::WINDOW;
+  }
+
+  Chronology<noteData> serial(params);
+  for (auto& e : score) serial.pushEvent(e.first, e.second);
+  serial.finalize();
+
+  for (unsigned int threads : { 1u, 3u, 8u }) {
+    Chronology<noteData> parallel =
+      ParallelFinalize::finalize<noteData>(score.begin(), score.end(), params, threads);
+
+    THEN("the sets are the same as those of the serial path") {
+      REQUIRE(parallel.size() == serial.size());
+      auto it = serial.begin();
+      for (auto& set : parallel) {
+        REQUIRE(set.dt == it->dt);
+        REQUIRE(set.events == it->events);
+        REQUIRE(set.offsets == it->offsets);
+        ++it;
+      }
+    }
+  }
+}
+
+SCENARIO("tables indexed by dense keys") {
+  KeyTable<commandData, commandKey, noteData> dense;
+  KeyTable<commandData, commandKey, noteData, false> sparse;
+
+  // Keys differing only by channel, or by id, must not be confused.
+
+  const std::vector<commandData> keys = {
+    makeCommand(true, 60, 100, 0),
+    makeCommand(true, 60, 100, 1),
+    makeCommand(true, 61, 100, 1),
+    makeCommand(false, 61, 0, 1) // Same key as the previous one
+  };
+
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    std::vector<noteData> ends = { makeNote(false, uint8_t(40 + i)) };
+    dense.set(keys[i], ends);
+    sparse.set(keys[i], ends);
+  }
+
+  dense.erase(keys[0]);
+  sparse.erase(keys[0]);
+
+  THEN("both give the same entries") {
+    for (auto& key : keys) {
+      std::vector<noteData>* d = dense.find(key);
+      std::vector<noteData>* s = sparse.find(key);
+      REQUIRE((d == nullptr) == (s == nullptr));
+      if (d != nullptr) REQUIRE(*d == *s);
+    }
+
+    REQUIRE(dense.find(keys[0]) == nullptr);
+    REQUIRE(dense.find(keys[2])->front() == makeNote(false, 43));
+  }
+
+  WHEN("they are cleared") {
+    dense.clear();
+    sparse.clear();
+    REQUIRE(dense.empty());
+    REQUIRE(sparse.empty());
+  }
+
+  THEN("only the keys used take memory") {
+    REQUIRE(dense.memoryUsage().reserved
+            < 8 * (sizeof(std::vector<noteData>) + sizeof(noteData)));
+  }
+
+  GIVEN("events out of the range of their key") {
+    // Channel 17 has the same index as channel 1, and id 188 as id 60.
+    Chronology<noteData> chronology;
+    chronology.pushEvent(0, makeNote(true, 60));
+    chronology.pushEvent(1, makeNote(true, 60, 100, 17));
+    chronology.pushEvent(1, makeNote(false, 60));
+    chronology.finalize();
+
+    MFPRenderer renderer;
+    renderer.setPartition(chronology);
+
+    THEN("they are dropped, their delay counting in the next event") {
+      REQUIRE(chronology.size() == 2);
+      REQUIRE(std::next(chronology.begin())->dt == 2);
+    }
+
+    THEN("so are the commands") {
+      REQUIRE(renderer.combine3(makeCommand(true, 60, 100, 17)).empty());
+      REQUIRE(renderer.combine3(makeCommand(true, 188)).empty());
+      REQUIRE(renderer.combine3(makeCommand(true, 60)) == std::vector<noteData>{ makeNote(true, 60) });
+    }
+  }
+}
+
+SCENARIO("carrying side events along with the notes") {
+  const controlData pedalDown = { 0xB1, 64, 127 };
+  const controlData pedalUp = { 0xB1, 64, 0 };
+  const controlData program = { 0xC1, 5, 0 };
+
+  Chronology<noteData> plain, carrying;
+
+  auto push = [&plain, &carrying](int dt, noteData note) { // To both
+    plain.pushEvent(dt, note);
+    carrying.pushEvent(dt, note);
+  };
+
+  // The delays of side events count in the delay of the next note.
+
+  carrying.pushSideEvent(0, program);
+  push(1, makeNote(true, 60));
+  carrying.pushSideEvent(1, pedalDown);
+  plain.pushEvent(2, makeNote(false, 60));
+  carrying.pushEvent(1, makeNote(false, 60));
+  push(0, makeNote(true, 62));
+  push(2, makeNote(false, 62));
+  carrying.pushSideEvent(1, pedalUp);
+
+  plain.finalize();
+  carrying.finalize();
+
+  THEN("the sets are unchanged") {
+    REQUIRE(carrying.size() == plain.size());
+    auto it = plain.begin();
+    for (auto& set : carrying) {
+      REQUIRE(set.dt == it->dt);
+      REQUIRE(set.events == it->events);
+      ++it;
+    }
+  }
+
+  THEN("side events are carried by the next start, or the final ending set") {
+    std::vector<std::vector<controlData>> sides;
+    for (auto& set : carrying) sides.push_back(set.side.events);
+
+    std::vector<std::vector<controlData>> expected = {
+      { program }, {}, { pedalDown }, { pedalUp }
+    };
+    REQUIRE(sides == expected);
+  }
+
+  THEN("views keep the side events, and drop the stats that may no longer hold") {
+    ChronologyParams::parameters params = ChronologyParams::default_params;
+    params.precomputeStats = true;
+    Chronology<noteData> withStats(params);
+    for (auto& set : carrying) {
+      for (auto& note : set.events) withStats.pushEvent(0, note);
+    }
+    withStats.finalize();
+    REQUIRE(withStats.begin()->stats.valid);
+
+    auto it = carrying.begin();
+    for (auto& set : ChronologyViews::filterEvents(carrying, channelFilter{ 5 })) {
+      REQUIRE(set.events.empty());
+      REQUIRE(set.side == it->side);
+      ++it;
+    }
+
+    auto unchanged = [](noteData const& note) { return note; };
+    it = carrying.begin();
+    for (auto& set : ChronologyViews::transformEvents(carrying, unchanged)) {
+      REQUIRE(set.side == it->side);
+      ++it;
+    }
+
+    for (auto& set : ChronologyViews::filterEvents(withStats, channelFilter{ 5 }))
+      REQUIRE(!set.stats.valid);
+    for (auto& set : ChronologyViews::transformEvents(withStats, unchanged))
+      REQUIRE(!set.stats.valid);
+  }
+
+  THEN("side events are counted in the memory usage") {
+    REQUIRE(carrying.memoryUsage().fifo.used
+            >= plain.memoryUsage().fifo.used + 3 * sizeof(controlData));
+  }
+
+  GIVEN("an interned chronology") {
+    InternedChronology<noteData> interned;
+    interned.pushSideEvent(0, program);
+    interned.pushEvent(1, makeNote(true, 60));
+    interned.pushSideEvent(1, pedalDown);
+    interned.pushEvent(1, makeNote(false, 60));
+    interned.pushEvent(0, makeNote(true, 62));
+    interned.pushEvent(2, makeNote(false, 62));
+    interned.pushSideEvent(1, pedalUp);
+    interned.finalize();
+
+    THEN("it keeps the side events") {
+      Chronology<noteData> restored = interned.toChronology();
+      auto it = carrying.begin();
+      for (auto& set : restored) {
+        REQUIRE(set.side == it->side);
+        ++it;
+      }
+    }
+  }
+
+  GIVEN("a renderer") {
+    MFPRenderer renderer;
+    renderer.setPartition(carrying);
+
+    THEN("side events are played with the set of their start") {
+      Events::Set<noteData> first = renderer.combine3Set(makeCommand(true, 60));
+      REQUIRE(first.side.events == std::vector<controlData>{ program });
+      REQUIRE(renderer.combine3Set(makeCommand(false, 60)).side.events.empty());
+      REQUIRE(renderer.combine3(makeCommand(true, 60)) == std::vector<noteData>{ makeNote(true, 62) });
+    }
+
+    THEN("a pedal up following the last note on is played with the last release") {
+      renderer.combine3(makeCommand(true, 60));
+      renderer.combine3(makeCommand(false, 60));
+      Events::Set<noteData> last = renderer.combine3Set(makeCommand(true, 61));
+      REQUIRE(last.side.events == std::vector<controlData>{ pedalDown });
+
+      REQUIRE(renderer.combine3Set(makeCommand(false, 61)).side.events
+              == std::vector<controlData>{ pedalUp });
+    }
+
+    THEN("the other engines play it with the last release too") {
+      for (CombineMode mode : { CombineMode::COMBINE_1, CombineMode::COMBINE_2 }) {
+        renderer.setPartition(carrying);
+        renderer.setCombineMode(mode);
+        renderer.combineSet(makeCommand(true, 60));
+        renderer.combineSet(makeCommand(false, 60));
+        REQUIRE(renderer.combineSet(makeCommand(true, 61)).side.events
+                == std::vector<controlData>{ pedalDown });
+        REQUIRE(renderer.combineSet(makeCommand(false, 61)).side.events
+                == std::vector<controlData>{ pedalUp });
+      }
+    }
+
+    THEN("so does the direct style") {
+      renderer.pushCommandEvent(0, makeCommand(true, 60));
+      renderer.pushCommandEvent(1, makeCommand(false, 60));
+      renderer.pushCommandEvent(1, makeCommand(true, 61));
+      renderer.pushCommandEvent(1, makeCommand(false, 61));
+      Chronology<noteData> rendered = renderer.renderCommands();
+      REQUIRE(rendered.size() == 4);
+      auto it = rendered.begin();
+      std::advance(it, 3);
+      REQUIRE(it->side.events == std::vector<controlData>{ pedalUp });
+    }
+  }
+}
+
+SCENARIO("carrying side events while streaming the sets") {
+  const controlData pedalUp = { 0xB1, 64, 0 };
+
+  auto push = [&pedalUp](Chronology<noteData>& c, std::vector<Events::Set<noteData>>* pulled) {
+    c.pushEvent(0, makeNote(true, 60));
+    c.pushEvent(2, makeNote(false, 60));
+    c.pushEvent(0, makeNote(true, 62));
+    c.pushEvent(2, makeNote(false, 62));
+    c.pushSideEvent(1, pedalUp);
+
+    if (pulled) {
+      while (c.hasFinalEventsSet()) pulled->push_back(c.pullFinalEventsSet());
+      REQUIRE(!pulled->empty()); // The first note is streamed
+    }
+
+    c.finalize();
+  };
+
+  auto sideCount = [](std::vector<Events::Set<noteData>> const& sets) {
+    std::size_t res = 0;
+    for (auto& set : sets) res += set.side.events.size();
+    return res;
+  };
+
+  Chronology<noteData> plain, streamed;
+  std::vector<Events::Set<noteData>> plainSets, streamedSets;
+
+  push(plain, nullptr);
+  for (auto& set : plain) plainSets.push_back(set);
+
+  push(streamed, &streamedSets);
+  for (auto& set : streamed) streamedSets.push_back(set);
+
+  THEN("the final ending set isn't pulled before finalize, and keeps the trailing events") {
+    REQUIRE(sideCount(plainSets) == 1);
+    REQUIRE(sideCount(streamedSets) == 1);
+    REQUIRE(streamedSets.size() == plainSets.size());
+  }
+}
@@ -0,0 +1,136 @@
+#include <catch2/catch_test_macros.hpp>
+#include "CommandCoalescer.h"
+#include "./utilities.h"
+
+SCENARIO("coalescing near-simultaneous presses") {
+
+  // SOME VARIABLES USED ACROSS TESTS //////////////////////////////////////////
+
+  const std::vector<noteEvent> score = {
+    { 0, makeNote(true,  60) },
+    { 0, makeNote(true,  64) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(false, 64) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) },
+    { 0, makeNote(true,  67) },
+    { 2, makeNote(false, 67) }
+  };
+
+  MFPRenderer renderer;
+  feedRenderer(renderer, score);
+
+  std::vector<std::vector<noteData>> batches;
+  CommandCoalescer coalescer(renderer, [&batches](Events::Set<noteData> const& set) {
+    batches.push_back(set.events);
+  }, 10);
+
+  // TESTS /////////////////////////////////////////////////////////////////////
+
+  GIVEN("a fist chord") {
+    coalescer.pushCommand(0, makeCommand(true, 40, 60));
+    coalescer.pushCommand(3, makeCommand(true, 41, 90));
+    coalescer.pushCommand(8, makeCommand(true, 42, 70));
+
+    THEN("nothing is played before the deadline") {
+      REQUIRE(batches.empty());
+      REQUIRE(coalescer.hasStagedCommands());
+      REQUIRE(coalescer.getDeadline() == 10);
+      coalescer.poll(9);
+      REQUIRE(batches.empty());
+    }
+
+    WHEN("the deadline passes") {
+      coalescer.poll(10);
+
+      THEN("the chord is a single step, with the loudest velocity") {
+        REQUIRE(batches == std::vector<std::vector<noteData>>{
+          { makeNote(true, 60, 90), makeNote(true, 64, 90) }
+        });
+      }
+
+      THEN("it is released with its last key") {
+        coalescer.pushCommand(20, makeCommand(false, 41, 0));
+        coalescer.pushCommand(21, makeCommand(false, 40, 0));
+        REQUIRE(batches.size() == 1);
+
+        coalescer.pushCommand(22, makeCommand(false, 42, 0));
+        REQUIRE(batches.size() == 2);
+        REQUIRE(batches[1] == std::vector<noteData>{
+          makeNote(false, 60), makeNote(false, 64)
+        });
+      }
+
+      THEN("the next press plays the next set") {
+        coalescer.pushCommand(50, makeCommand(true, 43, 100));
+        coalescer.poll(60);
+        REQUIRE(batches.size() == 2);
+        REQUIRE(batches[1] == std::vector<noteData>{ makeNote(true, 62, 100) });
+      }
+    }
+
+    WHEN("a key is released before the deadline") {
+      coalescer.pushCommand(9, makeCommand(false, 40, 0));
+
+      THEN("the chord is played first") {
+        REQUIRE(batches.size() == 1);
+        REQUIRE(!coalescer.hasStagedCommands());
+      }
+    }
+
+    WHEN("a key of the chord is pressed again within the window") {
+      coalescer.pushCommand(9, makeCommand(true, 40, 50));
+
+      THEN("it starts the next step, ending the chord") {
+        REQUIRE(batches.size() == 1);
+        REQUIRE(coalescer.hasStagedCommands());
+        coalescer.flush();
+        REQUIRE(batches[1] == std::vector<noteData>{
+          makeNote(true, 62, 50), makeNote(false, 60), makeNote(false, 64)
+        });
+
+        // The other keys of the chord have nothing left to release.
+
+        coalescer.pushCommand(20, makeCommand(false, 41, 0));
+        coalescer.pushCommand(20, makeCommand(false, 42, 0));
+        REQUIRE(batches.size() == 2);
+      }
+    }
+  }
+
+  GIVEN("a chord pressed on another channel") {
+    coalescer.pushCommand(0, makeCommand(true, 40, 60, 5));
+    coalescer.pushCommand(1, makeCommand(true, 41, 60, 5));
+    coalescer.flush();
+
+    THEN("it is released on the channel it was pressed on") {
+      coalescer.pushCommand(10, makeCommand(false, 41, 0, 5));
+      coalescer.pushCommand(11, makeCommand(false, 40, 0, 5));
+      REQUIRE(batches.size() == 2);
+      REQUIRE(batches[1] == std::vector<noteData>{
+        makeNote(false, 60), makeNote(false, 64)
+      });
+    }
+  }
+
+  GIVEN("no window") {
+    coalescer.setWindow(0);
+    coalescer.pushCommand(0, makeCommand(true, 40));
+    coalescer.pushCommand(0, makeCommand(true, 41));
+
+    THEN("each press is a step") {
+      REQUIRE(batches.size() == 2);
+      REQUIRE(batches[1] == std::vector<noteData>{ makeNote(true, 62) });
+    }
+  }
+
+  GIVEN("more presses than a group holds") {
+    for (std::size_t i = 0; i < CommandCoalescer::MAX_GROUP_SIZE; i++)
+      coalescer.pushCommand(0, makeCommand(true, uint8_t(40 + i)));
+
+    THEN("the full group is played at once") {
+      REQUIRE(batches.size() == 1);
+      REQUIRE(!coalescer.hasStagedCommands());
+    }
+  }
+}
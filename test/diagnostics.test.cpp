@@ -0,0 +1,66 @@
+#include <thread>
+#include <catch2/catch_test_macros.hpp>
+#include "Diagnostics.h"
+
+SCENARIO("posting diagnostics") {
+  std::vector<std::pair<Diagnostics::severity, std::string>> delivered;
+
+  Diagnostics::deliver(); // Left by other tests
+  Diagnostics::setSink([&delivered](Diagnostics::severity level, std::string const& text) {
+    delivered.push_back({ level, text });
+  });
+  Diagnostics::setMinimumSeverity(Diagnostics::severity::Info);
+
+  GIVEN("messages posted from another thread") {
+    std::thread thread([]() {
+      Diagnostics::warning("set {} has {} events", 3, 12);
+      Diagnostics::info("no arguments");
+      Diagnostics::error("{} then {}", -1);
+    });
+    thread.join();
+
+    THEN("nothing reaches the sink before delivery") {
+      REQUIRE(delivered.empty());
+    }
+
+    THEN("they are formatted and delivered in order") {
+      REQUIRE(Diagnostics::deliver() == 3);
+      REQUIRE(delivered.size() == 3);
+      REQUIRE(delivered[0].first == Diagnostics::severity::Warning);
+      REQUIRE(delivered[0].second == "set 3 has 12 events");
+      REQUIRE(delivered[1].second == "no arguments");
+      REQUIRE(delivered[2].first == Diagnostics::severity::Error);
+      REQUIRE(delivered[2].second == "-1 then {}"); // Missing arguments are left as is
+    }
+  }
+
+  GIVEN("a minimum severity") {
+    Diagnostics::setMinimumSeverity(Diagnostics::severity::Error);
+    Diagnostics::warning("dropped");
+    Diagnostics::error("kept");
+    MFP_DEBUG("never compiled unless requested");
+
+    THEN("messages of a lower severity are dropped") {
+      Diagnostics::deliver();
+      REQUIRE(delivered.size() == 1);
+      REQUIRE(delivered[0].second == "kept");
+    }
+  }
+
+  GIVEN("more messages than the queue holds") {
+    uint64_t dropped = Diagnostics::dropped();
+    for (std::size_t i = 0; i < Diagnostics::QUEUE_CAPACITY + 10; i++)
+      Diagnostics::info("message {}", i);
+
+    THEN("the extra ones are counted and dropped") {
+      REQUIRE(Diagnostics::dropped() - dropped == 10);
+      REQUIRE(Diagnostics::deliver() == Diagnostics::QUEUE_CAPACITY);
+      REQUIRE(delivered.back().second
+              == "message " + std::to_string(Diagnostics::QUEUE_CAPACITY - 1));
+    }
+  }
+
+  Diagnostics::deliver();
+  Diagnostics::setSink(Diagnostics::writeToStderr);
+  Diagnostics::setMinimumSeverity(Diagnostics::severity::Info);
+}
@@ -0,0 +1,77 @@
+#include <catch2/catch_test_macros.hpp>
+#include "IngestionGuard.h"
+#include "./utilities.h"
+
+SCENARIO("guarding the ingestion of commands") {
+
+  GIVEN("a key retriggered faster than the debounce") {
+    IngestionGuard guard({ 20, 0, 0 });
+
+    REQUIRE(guard.admit(0, makeCommand(true, 60)));
+    REQUIRE(!guard.admit(5, makeCommand(true, 60)));
+    REQUIRE(guard.admit(6, makeCommand(true, 61))); // Other keys are independent
+    REQUIRE(guard.admit(20, makeCommand(true, 60)));
+
+    THEN("the retriggers are dropped and counted") {
+      IngestionGuard::counters count = guard.getCounters();
+      REQUIRE(count.accepted == 3);
+      REQUIRE(count.debounced == 1);
+    }
+
+    THEN("a release is let through once for the accepted presses") {
+      REQUIRE(guard.admit(21, makeCommand(false, 60)));
+      REQUIRE(!guard.admit(22, makeCommand(false, 60)));
+      REQUIRE(guard.getCounters().orphanReleases == 1);
+    }
+
+    THEN("commands out of the range of the tables are dropped") {
+      // Its index would be that of the release of the accepted press.
+      REQUIRE(!guard.admit(21, makeCommand(false, 60, 0, 17)));
+      REQUIRE(guard.getCounters().outOfRange == 1);
+      REQUIRE(guard.admit(22, makeCommand(false, 60)));
+    }
+  }
+
+  GIVEN("a burst of presses") {
+    IngestionGuard guard({ 0, 10, 4 });
+
+    std::size_t admitted = 0;
+    for (uint8_t i = 0; i < 100; i++)
+      if (guard.admit(0, makeCommand(true, i))) admitted++;
+
+    THEN("only the burst is admitted at once") {
+      REQUIRE(admitted == 4);
+      REQUIRE(guard.getCounters().rateLimited == 96);
+    }
+
+    THEN("a token is given back every interval") {
+      REQUIRE(!guard.admit(9, makeCommand(true, 100)));
+      REQUIRE(guard.admit(10, makeCommand(true, 100)));
+      REQUIRE(!guard.admit(19, makeCommand(true, 101)));
+      REQUIRE(guard.admit(35, makeCommand(true, 101)));
+      REQUIRE(guard.admit(35, makeCommand(true, 102)));
+      REQUIRE(!guard.admit(35, makeCommand(true, 103)));
+    }
+
+    THEN("releases of admitted presses are never rate limited") {
+      for (uint8_t i = 0; i < 4; i++) REQUIRE(guard.admit(1, makeCommand(false, i)));
+      REQUIRE(!guard.admit(1, makeCommand(false, 4)));
+    }
+  }
+
+  GIVEN("an overloaded output") {
+    IngestionGuard guard;
+    REQUIRE(guard.admit(0, makeCommand(true, 60)));
+    guard.setOverloaded(true);
+
+    THEN("presses are shed, but the pending release still passes") {
+      REQUIRE(!guard.admit(100, makeCommand(true, 62)));
+      REQUIRE(guard.admit(100, makeCommand(false, 60)));
+      REQUIRE(!guard.admit(100, makeCommand(false, 62)));
+
+      IngestionGuard::counters count = guard.getCounters();
+      REQUIRE(count.shed == 1);
+      REQUIRE(count.orphanReleases == 1);
+    }
+  }
+}
@@ -0,0 +1,233 @@
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <catch2/catch_test_macros.hpp>
+#include "Journal.h"
+#include "./utilities.h"
+
+SCENARIO("journaling a session") {
+
+  // SOME VARIABLES USED ACROSS TESTS //////////////////////////////////////////
+
+  const std::vector<noteEvent> score = {
+    { 0, makeNote(true,  60) },
+    { 0, makeNote(true,  64) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(false, 64) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) }
+  };
+
+  const std::vector<commandData> session = {
+    makeCommand(true,  60, 100, 0),
+    makeCommand(false, 60, 0,   0),
+    makeCommand(true,  61, 80,  0),
+    makeCommand(false, 61, 0,   0)
+  };
+
+  std::string path =
+    (std::filesystem::temp_directory_path() / "mfpJournalTest.mfpj").string();
+
+  Journal::session settings = {
+    0x0123456789ABCDEF,
+    ChronologyParams::default_params,
+    CombineMode::COMBINE_3,
+    VoiceStealing::StrategyType::OnlyStaccato,
+    ChordVelocityMapping::StrategyType::ClippedScaledFromMax,
+    true
+  };
+  settings.params.temporalResolution = 20;
+  settings.params.clustering = ChronologyParams::clusteringOption::WINDOW;
+
+  Journal::session readSettings;
+
+  auto readBack = [&path, &readSettings](std::vector<Journal::entry>& entries) {
+    std::ifstream in(path, std::ios::binary);
+    return Journal::read(in, readSettings, entries);
+  };
+
+  // TESTS /////////////////////////////////////////////////////////////////////
+
+  GIVEN("a journaled performance") {
+    MFPRenderer renderer;
+    feedRenderer(renderer, score);
+
+    Replay::performance played;
+
+    {
+      Journal journal(path, settings);
+      REQUIRE(journal.isOpen());
+
+      for (auto& cmd : session) {
+        journal.command(cmd);
+        played.push_back(renderer.combine3(cmd));
+        journal.output(played.back());
+      }
+
+      journal.flush();
+      REQUIRE(journal.dropped() == 0);
+    }
+
+    std::vector<Journal::entry> entries;
+    REQUIRE(readBack(entries));
+
+    THEN("the session is read back") {
+      REQUIRE(readSettings.partitionKey == settings.partitionKey);
+      REQUIRE(readSettings.params.unmeet == settings.params.unmeet);
+      REQUIRE(readSettings.params.complete == settings.params.complete);
+      REQUIRE(readSettings.params.shiftMode == settings.params.shiftMode);
+      REQUIRE(readSettings.params.temporalResolution == 20);
+      REQUIRE(readSettings.params.clustering == ChronologyParams::clusteringOption::WINDOW);
+      REQUIRE(readSettings.combineMode == CombineMode::COMBINE_3);
+      REQUIRE(readSettings.voiceStealing == VoiceStealing::StrategyType::OnlyStaccato);
+      REQUIRE(readSettings.chordRendering == ChordVelocityMapping::StrategyType::ClippedScaledFromMax);
+      REQUIRE(readSettings.useCommandVelocity);
+    }
+
+    THEN("every command and output is read back in order") {
+      REQUIRE(entries.size() == 2 * session.size());
+
+      Replay::performance outputs;
+      REQUIRE(Journal::outputs(entries, outputs));
+      REQUIRE(outputs == played);
+
+      std::vector<Replay::timedCommand> commands = Journal::commands(entries);
+      REQUIRE(commands.size() == session.size());
+      for (std::size_t i = 0; i < session.size(); i++) {
+        REQUIRE(commands[i].second.id == session[i].id);
+        REQUIRE(commands[i].second.pressed == session[i].pressed);
+        REQUIRE(commands[i].second.velocity == session[i].velocity);
+        REQUIRE(commands[i].first >= 0);
+      }
+
+      for (std::size_t i = 1; i < entries.size(); i++)
+        REQUIRE(entries[i].time >= entries[i - 1].time);
+    }
+
+    THEN("replaying the journaled commands gives the journaled outputs") {
+      MFPRenderer replayed;
+      feedRenderer(replayed, score);
+
+      Replay::performance outputs;
+      Journal::outputs(entries, outputs);
+      REQUIRE(!Replay::diff(replayed, Journal::commands(entries), outputs).found);
+    }
+
+    WHEN("the journal is cut in the middle of a record") {
+      std::filesystem::resize_file(path, std::filesystem::file_size(path) - 5);
+
+      THEN("the complete records are kept, and the last batch is incomplete") {
+        std::vector<Journal::entry> cut;
+        REQUIRE(readBack(cut));
+        REQUIRE(cut.size() == entries.size());
+        REQUIRE(cut.back().notes.size() + 1 == entries.back().notes.size());
+        REQUIRE(!cut.back().complete);
+
+        Replay::performance outputs;
+        REQUIRE(!Journal::outputs(cut, outputs));
+      }
+    }
+  }
+
+  GIVEN("a queue too small for the records") {
+    uint64_t dropped;
+
+    {
+      Journal journal(path, settings, 2);
+      for (int i = 0; i < 1000; i++) journal.command(session[0]);
+      dropped = journal.dropped();
+    }
+
+    std::vector<Journal::entry> entries;
+    REQUIRE(readBack(entries));
+
+    THEN("records are dropped rather than waited for, and counted") {
+      uint64_t reported = 0, kept = 0;
+      for (auto& e : entries) {
+        if (e.type == Journal::recordType::DROPPED) reported += e.dropped;
+        else kept++;
+      }
+      REQUIRE(kept + dropped == 1000);
+      REQUIRE(reported <= dropped); // The last ones may not be reported
+    }
+  }
+
+  GIVEN("a batch carrying side events") {
+    Events::Set<noteData> set = { 0, { makeNote(true, 60), makeNote(true, 64) }, {}, {}, {} };
+    set.side.events = { { 0xB1, 64, 127 }, { 0xC1, 5, 0 } };
+
+    {
+      Journal journal(path, settings);
+      journal.output(set);
+    }
+
+    std::vector<Journal::entry> entries;
+    REQUIRE(readBack(entries));
+
+    THEN("the side events are read back with the notes") {
+      REQUIRE(entries.size() == 1);
+      REQUIRE(entries[0].complete);
+      REQUIRE(entries[0].notes == set.events);
+      REQUIRE(entries[0].controls == set.side.events);
+    }
+  }
+
+  GIVEN("batches recorded from several threads") {
+    const std::size_t batchCount = 200;
+    const std::vector<noteData> first = {
+      makeNote(true, 60, 100, 0), makeNote(true, 60, 100, 0), makeNote(true, 60, 100, 0)
+    };
+    const std::vector<noteData> second = {
+      makeNote(true, 70, 50, 1), makeNote(true, 70, 50, 1), makeNote(true, 70, 50, 1)
+    };
+
+    {
+      Journal journal(path, settings);
+      std::thread other([&]() {
+        for (std::size_t i = 0; i < batchCount; i++) journal.output(second);
+      });
+      for (std::size_t i = 0; i < batchCount; i++) journal.output(first);
+      other.join();
+      journal.flush();
+      REQUIRE(journal.dropped() == 0);
+    }
+
+    std::vector<Journal::entry> entries;
+    REQUIRE(readBack(entries));
+
+    THEN("each batch gets its own notes back, whatever the interleaving") {
+      Replay::performance outputs;
+      REQUIRE(Journal::outputs(entries, outputs));
+      REQUIRE(outputs.size() == 2 * batchCount);
+      for (auto& notes : outputs) REQUIRE((notes == first || notes == second));
+    }
+  }
+
+  GIVEN("batches in a queue too small for them") {
+    const std::vector<noteData> chord = {
+      makeNote(true, 60), makeNote(true, 64), makeNote(true, 67), makeNote(true, 72)
+    };
+
+    {
+      Journal journal(path, settings, 2);
+      for (int i = 0; i < 1000; i++) journal.output(chord);
+    }
+
+    std::vector<Journal::entry> entries;
+    REQUIRE(readBack(entries));
+
+    THEN("a batch that lost notes is marked incomplete rather than kept short") {
+      bool incomplete = false;
+      for (auto& e : entries) {
+        if (e.type != Journal::recordType::OUTPUT) continue;
+        if (e.complete) REQUIRE(e.notes == chord);
+        else incomplete = true;
+      }
+
+      Replay::performance outputs;
+      if (incomplete) REQUIRE(!Journal::outputs(entries, outputs));
+    }
+  }
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <sstream>
+#include <catch2/catch_test_macros.hpp>
+#include "MidiFileWriter.h"
+#include "./utilities.h"
+
+SCENARIO("writing a performance as a MIDI file") {
+
+  // UTILITIES /////////////////////////////////////////////////////////////////
+
+  auto bytesOf = [](std::stringstream& stream) -> std::vector<uint8_t> {
+    std::string s = stream.str();
+    return std::vector<uint8_t>(s.begin(), s.end());
+  };
+
+  // The header and the tempo event of every file written with default settings.
+
+  auto header = [](uint32_t trackLength) -> std::vector<uint8_t> {
+    return {
+      'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x01, 0xE0,
+      'M', 'T', 'r', 'k',
+      uint8_t(trackLength >> 24), uint8_t(trackLength >> 16),
+      uint8_t(trackLength >> 8), uint8_t(trackLength),
+      0x00, 0xFF, 0x51, 0x03, 0x07, 0x53, 0x00
+    };
+  };
+
+  const std::vector<uint8_t> endOfTrack = { 0xFF, 0x2F, 0x00 };
+
+  // PERFORMING TESTS //////////////////////////////////////////////////////////
+
+  GIVEN("a few chords") {
+    std::stringstream stream;
+
+    {
+      MidiFileWriter writer(stream);
+      writer.write(0, { makeNote(true, 60, 100, 0), makeNote(true, 64, 90, 0) });
+      writer.write(200, { makeNote(false, 60, 0, 0), makeNote(false, 64, 0, 0) });
+      writer.write(200, { makeNote(true, 67, 80, 0) });
+      writer.write(1000, { makeNote(false, 67, 0, 0) });
+      writer.close();
+    }
+
+    THEN("delta times use variable lengths and statuses are only repeated when they change") {
+      std::vector<uint8_t> expected = header(7 + 4 + 3 + 5 + 3 + 4 + 5 + 4);
+      std::vector<uint8_t> events = {
+        0x00, 0x90, 60, 100,
+        0x00, 64, 90,
+        0x81, 0x48, 0x80, 60, 0, // 200 ticks
+        0x00, 64, 0,
+        0x00, 0x90, 67, 80,
+        0x86, 0x20, 0x80, 67, 0, // 800 ticks
+        0x00
+      };
+      expected.insert(expected.end(), events.begin(), events.end());
+      expected.insert(expected.end(), endOfTrack.begin(), endOfTrack.end());
+
+      REQUIRE(bytesOf(stream) == expected);
+    }
+  }
+
+  GIVEN("a set whose offsets are in ticks") {
+    std::stringstream stream;
+    Events::Set<noteData> set = { 0, { makeNote(true, 60, 100, 0), makeNote(true, 64, 90, 0) }, {}, {}, {} };
+    Events::appendEvent(set, makeNote(true, 67, 80, 0), 10);
+
+    {
+      MidiFileWriter writer(stream);
+      writer.write(100, set, std::chrono::milliseconds(2));
+      REQUIRE(writer.close());
+    }
+
+    THEN("the offsets are scaled by the duration of a tick") {
+      std::vector<uint8_t> events = {
+        0x64, 0x90, 60, 100, // 100 ticks
+        0x00, 64, 90,
+        0x14, 67, 80, // 20 ticks
+        0x00
+      };
+      std::vector<uint8_t> bytes = bytesOf(stream);
+      REQUIRE(std::equal(events.begin(), events.end(), bytes.begin() + header(0).size()));
+    }
+  }
+
+  GIVEN("a stream that fails") {
+    std::ostream broken(nullptr);
+    MidiFileWriter writer(broken);
+    writer.write(0, { makeNote(true, 60, 100, 0) });
+
+    THEN("the failure is reported") {
+      REQUIRE(!writer.good());
+      REQUIRE(!writer.close());
+    }
+  }
+
+  GIVEN("a performance longer than the buffer of the writer") {
+    std::stringstream stream;
+    const int noteCount = 3000;
+
+    {
+      MidiFileWriter writer(stream);
+      for (int i = 0; i < noteCount; i++) {
+        writer.write(i, { makeNote(true, 60, 100, 0) });
+        writer.write(i, { makeNote(false, 60, 0, 0) });
+      }
+    } // Closed by the destructor.
+
+    THEN("every event is written, and the length of the track matches") {
+      std::vector<uint8_t> bytes = bytesOf(stream);
+
+      // Tempo event, alternating note ons and offs with their status,
+      // end of track.
+      uint32_t trackLength = 7 + 2 * noteCount * 4 + 4;
+
+      std::vector<uint8_t> expected = header(trackLength);
+
+      REQUIRE(bytes.size() == 22 + trackLength);
+      REQUIRE(std::equal(expected.begin(), expected.end(), bytes.begin()));
+    }
+  }
+}
@@ -0,0 +1,143 @@
+#include <fstream>
+#include <catch2/catch_test_macros.hpp>
+#include "PartitionCache.h"
+#include "./utilities.h"
+
+SCENARIO("caching finalized partitions") {
+
+  // SOME VARIABLES USED ACROSS TESTS //////////////////////////////////////////
+
+  const std::vector<noteEvent> score = {
+    { 1, makeNote(true,  60) },
+    { 0, makeNote(true,  64) },
+    { 2, makeNote(false, 60) },
+    { 1, makeNote(false, 64) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) },
+    { 0, makeNote(true,  67) },
+    { 2, makeNote(false, 67) }
+  };
+
+  std::filesystem::path directory =
+    std::filesystem::temp_directory_path() / "mfpPartitionCacheTest";
+  std::filesystem::remove_all(directory);
+
+  ChronologyParams::parameters params = ChronologyParams::default_params;
+  params.temporalResolution = 1;
+
+  Chronology<noteData> reference(params);
+  for (auto& event : score) reference.pushEvent(event.first, event.second);
+  reference.finalize();
+
+  auto identical = [](Chronology<noteData> const& c1, Chronology<noteData> const& c2) {
+    if (c1.size() != c2.size()) return false;
+    auto it = c2.begin();
+    for (auto& set : c1) {
+      if (set.dt != it->dt || set.events != it->events || set.offsets != it->offsets)
+        return false;
+      ++it;
+    }
+    return true;
+  };
+
+  auto keyOf = [&score](ChronologyParams::parameters p) {
+    PartitionCache::keyBuilder builder(p);
+    for (auto& event : score) builder.add(event.first, event.second);
+    return builder.value();
+  };
+
+  // TESTS /////////////////////////////////////////////////////////////////////
+
+  GIVEN("a score opened once") {
+    PartitionCache cache(directory);
+    Chronology<noteData> opened = cache.open(score.begin(), score.end(), params);
+
+    THEN("it is preprocessed and stored") {
+      REQUIRE(identical(opened, reference));
+      REQUIRE(cache.size() > 0);
+    }
+
+    THEN("opening it again loads the same partition") {
+      Chronology<noteData> loaded(params);
+      REQUIRE(cache.load(keyOf(params), params, loaded));
+      REQUIRE(identical(loaded, reference));
+      REQUIRE(identical(cache.open(score.begin(), score.end(), params), reference));
+    }
+
+    THEN("other parameters give another key") {
+      ChronologyParams::parameters other = params;
+      other.complete = true;
+      REQUIRE(keyOf(other) != keyOf(params));
+
+      Chronology<noteData> loaded(other);
+      REQUIRE(!cache.load(keyOf(other), other, loaded));
+    }
+
+    WHEN("its file is corrupted") {
+      for (auto& file : std::filesystem::directory_iterator(directory)) {
+        std::fstream f(file.path(), std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(20);
+        f.put(char(0x7F));
+      }
+
+      THEN("it is a miss, and the file is removed") {
+        Chronology<noteData> loaded(params);
+        REQUIRE(!cache.load(keyOf(params), params, loaded));
+        REQUIRE(cache.size() == 0);
+      }
+    }
+  }
+
+  GIVEN("a cache too small for two partitions") {
+    PartitionCache probe(directory);
+    probe.store(1, reference);
+    std::uintmax_t partitionSize = probe.size();
+    probe.clear();
+
+    PartitionCache cache(directory, partitionSize * 3 / 2);
+    cache.store(1, reference);
+
+    // Make sure the second partition is more recent than the first.
+
+    std::filesystem::last_write_time(
+      directory / "0000000000000001.mfpp",
+      std::filesystem::file_time_type::clock::now() - std::chrono::hours(1)
+    );
+
+    cache.store(2, reference);
+
+    THEN("the least recently used one is evicted") {
+      Chronology<noteData> loaded(params);
+      REQUIRE(!cache.load(1, params, loaded));
+      REQUIRE(cache.load(2, params, loaded));
+    }
+  }
+
+  GIVEN("temporaries left in the directory") {
+    std::filesystem::create_directories(directory);
+    std::filesystem::path stale = directory / "0000000000000001.mfpp.tmp0-1";
+    std::filesystem::path current = directory / "0000000000000002.mfpp.tmp1-1";
+
+    for (auto& path : { stale, current }) {
+      std::ofstream out(path, std::ios::binary);
+      out << "partial";
+    }
+
+    std::filesystem::last_write_time(
+      stale, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1)
+    );
+
+    PartitionCache cache(directory);
+
+    THEN("those left by a crash are removed when the cache is opened") {
+      REQUIRE(!std::filesystem::exists(stale));
+      REQUIRE(std::filesystem::exists(current));
+    }
+
+    THEN("the others count in the size of the cache") {
+      REQUIRE(cache.size() == std::filesystem::file_size(current));
+    }
+  }
+
+  std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,115 @@
+#include <sstream>
+#include <catch2/catch_test_macros.hpp>
+#include "MidiFileWriter.h"
+#include "Replay.h"
+#include "./utilities.h"
+
+SCENARIO("replaying recorded sessions") {
+
+  // SOME VARIABLES USED ACROSS TESTS //////////////////////////////////////////
+
+  const std::vector<noteEvent> score = {
+    { 0, makeNote(true,  60) },
+    { 0, makeNote(true,  64) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(false, 64) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) },
+    { 0, makeNote(true,  67) },
+    { 2, makeNote(false, 67) }
+  };
+
+  const std::vector<Replay::timedCommand> session = {
+    {   0, makeCommand(true,  60, 100, 0) },
+    { 120, makeCommand(false, 60, 0,   0) },
+    {  30, makeCommand(true,  61, 80,  0) },
+    {   0, makeCommand(true,  62, 70,  0) },
+    { 200, makeCommand(false, 61, 0,   0) },
+    {  10, makeCommand(false, 62, 0,   0) }
+  };
+
+  auto sameCommands = [](const std::vector<Replay::timedCommand>& c1,
+                         const std::vector<Replay::timedCommand>& c2) {
+    if (c1.size() != c2.size()) return false;
+    for (std::size_t i = 0; i < c1.size(); i++) {
+      if (c1[i].first != c2[i].first) return false;
+      if (!(Events::keyFromData<commandData, commandKey>(c1[i].second)
+            == Events::keyFromData<commandData, commandKey>(c2[i].second))) return false;
+      if (c1[i].second.pressed != c2[i].second.pressed) return false;
+      if (c1[i].second.velocity != c2[i].second.velocity) return false;
+    }
+    return true;
+  };
+
+  MFPRenderer renderer;
+
+  // PERFORMING TESTS //////////////////////////////////////////////////////////
+
+  GIVEN("a session recorded as a command log") {
+    std::stringstream log;
+    Replay::writeCommandLog(log, session);
+
+    THEN("reading the log gives back the same commands") {
+      std::vector<Replay::timedCommand> commands;
+      REQUIRE(Replay::readCommandLog(log, commands));
+      REQUIRE(sameCommands(commands, session));
+    }
+
+    THEN("a truncated log is rejected") {
+      std::string truncated = log.str();
+      truncated.pop_back();
+      std::stringstream in(truncated);
+      std::vector<Replay::timedCommand> commands;
+      REQUIRE(!Replay::readCommandLog(in, commands));
+    }
+  }
+
+  GIVEN("a session recorded as a MIDI file") {
+    std::stringstream file;
+
+    {
+      MidiFileWriter writer(file);
+      int64_t time = 0;
+      for (auto& command : session) {
+        time += command.first;
+        commandData const& cmd = command.second;
+        writer.write(time, { makeNote(cmd.pressed, cmd.id, cmd.velocity, cmd.channel) });
+      }
+    }
+
+    THEN("reading the file gives back the same commands") {
+      std::vector<Replay::timedCommand> commands;
+      REQUIRE(Replay::readMidiFileCommands(file, commands));
+      REQUIRE(sameCommands(commands, session));
+    }
+  }
+
+  GIVEN("a golden output") {
+    feedRenderer(renderer, score);
+    Replay::performance golden = Replay::render(renderer, session);
+
+    THEN("replaying the session gives the same hash") {
+      feedRenderer(renderer, score);
+      REQUIRE(Replay::hash(renderer, session) == Replay::hash(golden));
+    }
+
+    THEN("replaying the session finds no difference") {
+      feedRenderer(renderer, score);
+      REQUIRE(!Replay::diff(renderer, session, golden).found);
+    }
+
+    THEN("a different output is reported at its first difference") {
+      Replay::performance altered = golden;
+      altered[2][0].velocity++;
+
+      feedRenderer(renderer, score);
+      Replay::mismatch m = Replay::diff(renderer, session, altered);
+
+      REQUIRE(m.found);
+      REQUIRE(m.command == 2);
+      REQUIRE(m.actual == golden[2]);
+      REQUIRE(m.expected == altered[2]);
+      REQUIRE(Replay::hash(altered) != Replay::hash(golden));
+    }
+  }
+}
@@ -0,0 +1,180 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Scheduler.h"
+#include "MFPRenderer.h"
+#include "./utilities.h"
+
+SCENARIO("scheduling the events of a set at their offsets") {
+
+  typedef Scheduler<noteData>::clock clock;
+  typedef std::chrono::milliseconds ms;
+
+  std::vector<noteData> emitted;
+  auto emit = [&emitted](noteData const& note) { emitted.push_back(note); };
+
+  Scheduler<noteData> scheduler(ms(1));
+  clock::time_point t0 = clock::now();
+
+  GIVEN("a rolled chord") {
+    Events::Set<noteData> chord = {
+      0,
+      { makeNote(true, 60), makeNote(true, 64), makeNote(true, 67) },
+      { 0, 5, 10 },
+      {},
+      {}
+    };
+
+    scheduler.schedule(chord, t0, emit);
+
+    THEN("the first note is emitted right away") {
+      REQUIRE(emitted.size() == 1);
+      REQUIRE(emitted[0] == makeNote(true, 60));
+    }
+
+    THEN("the other notes are emitted at their offsets") {
+      scheduler.advance(t0 + ms(4), emit);
+      REQUIRE(emitted.size() == 1);
+      scheduler.advance(t0 + ms(5), emit);
+      REQUIRE(emitted.size() == 2);
+      REQUIRE(emitted[1] == makeNote(true, 64));
+      scheduler.advance(t0 + ms(300), emit);
+      REQUIRE(emitted.size() == 3);
+      REQUIRE(emitted[2] == makeNote(true, 67));
+      REQUIRE(scheduler.empty());
+    }
+
+    THEN("pending notes are emitted before the next set") {
+      scheduler.schedule({ 10, { makeNote(true, 72) }, {}, {}, {} }, t0 + ms(1), emit);
+      REQUIRE(emitted.size() == 4);
+      REQUIRE(emitted[3] == makeNote(true, 72));
+    }
+  }
+
+  GIVEN("a set carrying controls") {
+    Events::Set<noteData> set = { 0, { makeNote(true, 60), makeNote(true, 64) }, { 0, 5 }, {}, {} };
+    set.side.events = { { 0xB1, 64, 127 } };
+
+    std::vector<std::size_t> notesBeforeControls;
+    scheduler.schedule(set, t0, emit, [&](controlData const& control) {
+      REQUIRE(control == controlData{ 0xB1, 64, 127 });
+      notesBeforeControls.push_back(emitted.size());
+    }, 0);
+
+    THEN("they are emitted right away, before the notes") {
+      REQUIRE(notesBeforeControls == std::vector<std::size_t>{ 0 });
+      REQUIRE(emitted.size() == 1);
+    }
+  }
+
+  GIVEN("offsets beyond the near wheel") {
+    Events::Set<noteData> set = {
+      0,
+      { makeNote(true, 60), makeNote(true, 62), makeNote(true, 64) },
+      { 70000, 300, 1000 },
+      {},
+      {}
+    };
+
+    scheduler.schedule(set, t0, emit);
+
+    THEN("notes are cascaded and emitted in time order") {
+      scheduler.advance(t0 + ms(299), emit);
+      REQUIRE(emitted.empty());
+      scheduler.advance(t0 + ms(1000), emit);
+      REQUIRE(emitted.size() == 2);
+      REQUIRE(emitted[0] == makeNote(true, 62));
+      REQUIRE(emitted[1] == makeNote(true, 64));
+      scheduler.advance(t0 + ms(70000), emit);
+      REQUIRE(emitted.size() == 3);
+      REQUIRE(emitted[2] == makeNote(true, 60));
+    }
+  }
+}
+
+SCENARIO("keeping offsets through the renderer") {
+
+  const std::vector<noteEvent> graceScore = {
+    { 0, makeNote(true,  60) },
+    { 3, makeNote(true,  62) },
+    { 10, makeNote(false, 60) },
+    { 0, makeNote(false, 62) },
+  };
+
+  ChronologyParams::parameters params = ChronologyParams::default_params;
+  params.temporalResolution = 5;
+
+  MFPRenderer renderer(params);
+  renderer.setVoiceStealingStrategy(VoiceStealing::StrategyType::None);
+  feedRenderer(renderer, graceScore);
+
+  auto res = renderer.combine3Set(makeCommand(true, 60));
+
+  THEN("events clustered together keep their offsets") {
+    REQUIRE(res.events.size() == 2);
+    REQUIRE(Events::offsetOf(res, 0) == 0);
+    REQUIRE(Events::offsetOf(res, 1) == 3);
+  }
+}
+
+SCENARIO("following the tempo of the player") {
+
+  typedef Scheduler<noteData>::clock clock;
+  typedef std::chrono::milliseconds ms;
+
+  // Onsets 100 ticks apart, each note lasting half of it :
+  // starting sets are only 50 ticks after the ending set before them.
+
+  const std::vector<noteEvent> staccatoScore = {
+    { 0,  makeNote(true,  60) },
+    { 50, makeNote(false, 60) },
+    { 50, makeNote(true,  62) },
+    { 50, makeNote(false, 62) },
+    { 50, makeNote(true,  64) },
+    { 50, makeNote(false, 64) },
+    { 50, makeNote(true,  65) },
+    { 50, makeNote(false, 65) }
+  };
+
+  MFPRenderer renderer;
+  renderer.setVoiceStealingStrategy(VoiceStealing::StrategyType::None);
+  feedRenderer(renderer, staccatoScore);
+
+  Scheduler<noteData> scheduler(ms(1));
+  auto emit = [](noteData const&) {};
+  clock::time_point t0 = clock::now();
+
+  // Play each note at the given interval, and record the tick durations.
+
+  auto play = [&](ms interval) {
+    std::vector<clock::duration> ticks;
+    for (int i = 0; i < 4; i++) {
+      Events::Set<noteData> set = renderer.combine3Set(makeCommand(true, 60));
+      if (i > 0) {
+        REQUIRE(set.dt == 50);
+        REQUIRE(renderer.getOnsetDistance() == 100);
+      }
+      scheduler.schedule(set, t0 + i * interval, emit, renderer.getOnsetDistance());
+      renderer.combine3Set(makeCommand(false, 60));
+      ticks.push_back(scheduler.getTickDuration());
+    }
+    return ticks;
+  };
+
+  GIVEN("a player at the tempo of the score") {
+    std::vector<clock::duration> ticks = play(ms(100));
+
+    THEN("the tick duration is unchanged") {
+      for (auto& tick : ticks) REQUIRE(tick == ms(1));
+    }
+  }
+
+  GIVEN("a player twice as slow") {
+    std::vector<clock::duration> ticks = play(ms(200));
+
+    THEN("the tick duration goes towards twice the nominal one") {
+      REQUIRE(ticks[0] == ms(1));
+      REQUIRE(ticks[1] == std::chrono::microseconds(1500));
+      REQUIRE(ticks[2] == std::chrono::microseconds(1750));
+      REQUIRE(ticks[3] == std::chrono::microseconds(1875));
+    }
+  }
+}
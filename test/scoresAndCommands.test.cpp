@@ -1,6 +1,8 @@
 #include <iostream>
 #include <catch2/catch_test_macros.hpp>
 #include "MFPRenderer.h"
+#include "NoteTransform.h"
+#include "ChronologyViews.h"
 #include "./utilities.h"
 
 // VARIOUS SCORES //////////////////////////////////////////////////////////////
@@ -367,3 +369,215 @@ TEST_CASE("desync") {
   REQUIRE(performanceResultsAreIdentical(res, expected));
   // REQUIRE(true);
 }
+
+TEST_CASE("offline rendering") {
+  MFPRenderer live, offline;
+
+  feedRenderer(live, incompleteCoherentScore);
+  feedRenderer(offline, incompleteCoherentScore);
+
+  // Commands are recorded 10 ticks apart.
+
+  for (auto& command : genericCommands) offline.pushCommandEvent(10, command);
+
+  auto expected = getPerformanceResults(live, genericCommands);
+  Chronology<noteData> rendered = offline.renderCommands();
+
+  // Each non-empty result of the live performance is a set of the rendering,
+  // dated by the command that triggered it.
+
+  auto set = rendered.begin();
+  int64_t time = 0;
+
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    if (expected[i].empty()) continue;
+
+    REQUIRE(set != rendered.end());
+    time += set->dt;
+    REQUIRE(time == 10 * int64_t(i + 1));
+    REQUIRE(set->events == expected[i]);
+    ++set;
+  }
+
+  REQUIRE(set == rendered.end());
+
+  // The partition is left untouched, so rendering again gives the same result.
+
+  Chronology<noteData> renderedAgain = offline.renderCommands();
+  REQUIRE(renderedAgain.size() == rendered.size());
+}
+
+TEST_CASE("combine engines") {
+  MFPRenderer engine;
+
+  auto perform = [&engine](CombineMode mode,
+                           const std::vector<commandData>& commands) {
+    engine.setCombineMode(mode);
+    feedRenderer(engine, minimalScore);
+    std::vector<std::vector<noteData>> res;
+    for (auto& command : commands) res.push_back(engine.combine(command));
+    return res;
+  };
+
+  const std::vector<commandData> crossedCommands = {
+    makeCommand(true,   60),
+    makeCommand(true,   62),
+    makeCommand(false,  62),
+    makeCommand(false,  60),
+    makeCommand(true,   61)
+  };
+
+  const std::vector<noteData> allEnds = {
+    makeNote(false, 60),
+    makeNote(false, 62)
+  };
+
+  SECTION("combine_0 plays the ends with the next press") {
+    std::vector<std::vector<noteData>> expected = {
+      { makeNote(true,  60) },
+      { makeNote(true,  62) },
+      {},
+      {},
+      allEnds
+    };
+
+    auto res = perform(CombineMode::COMBINE_0, crossedCommands);
+    REQUIRE(performanceResultsAreIdentical(res, expected));
+  }
+
+  SECTION("combine_1 plays the ends with the next command") {
+    std::vector<std::vector<noteData>> expected = {
+      { makeNote(true,  60) },
+      { makeNote(true,  62) },
+      allEnds,
+      {},
+      {}
+    };
+
+    auto res = perform(CombineMode::COMBINE_1, crossedCommands);
+    REQUIRE(performanceResultsAreIdentical(res, expected));
+  }
+
+  SECTION("combine_2 plays the ends in the order of the presses") {
+    std::vector<std::vector<noteData>> expected = {
+      { makeNote(true,  60) },
+      { makeNote(true,  62) },
+      {},
+      allEnds,
+      {}
+    };
+
+    auto res = perform(CombineMode::COMBINE_2, crossedCommands);
+    REQUIRE(performanceResultsAreIdentical(res, expected));
+  }
+
+  SECTION("combine_3 plays the ends with the release of their key") {
+    std::vector<std::vector<noteData>> expected = {
+      { makeNote(true,  60) },
+      { makeNote(true,  62) },
+      allEnds,
+      {},
+      {}
+    };
+
+    auto res = perform(CombineMode::COMBINE_3, crossedCommands);
+    REQUIRE(performanceResultsAreIdentical(res, expected));
+  }
+}
+
+TEST_CASE("transformed performance") {
+  MFPRenderer plain, transformed;
+
+  feedRenderer(plain, incompleteCoherentScore);
+  feedRenderer(transformed, incompleteCoherentScore);
+
+  NoteTransform t = NoteTransform::transpose(2)
+    .then(NoteTransform::remapChannel(defaultChannel, 3))
+    .then(NoteTransform::velocityCurve([](uint8_t v) { return v / 2; }));
+
+  REQUIRE(transformed.setTransform(t));
+
+  // The same transform, as a view over the partition.
+
+  Chronology<noteData> partition = plain.getPartition();
+  auto set = partition.begin();
+
+  for (auto& transformedSet : ChronologyViews::transformEvents(partition, t)) {
+    REQUIRE(transformedSet.dt == set->dt);
+    REQUIRE(transformedSet.events.size() == set->events.size());
+    for (std::size_t i = 0; i < set->events.size(); ++i)
+      REQUIRE(transformedSet.events[i] == t(set->events[i]));
+    ++set;
+  }
+
+  REQUIRE(set == partition.end());
+
+  auto expected = getPerformanceResults(plain, genericCommands);
+  auto res = getPerformanceResults(transformed, genericCommands);
+
+  REQUIRE(res.size() == expected.size());
+
+  for (std::size_t i = 0; i < res.size(); ++i) {
+    REQUIRE(res[i].size() == expected[i].size());
+
+    for (std::size_t j = 0; j < res[i].size(); ++j) {
+      noteData note = expected[i][j];
+      note.pitch += 2;
+      note.channel = 3;
+      if (note.on) note.velocity = std::max(1, note.velocity / 2);
+      REQUIRE(res[i][j] == note);
+    }
+  }
+
+  SECTION("transforms merging notes are rejected") {
+    feedRenderer(transformed, incompleteCoherentScore);
+    transformed.clearTransform();
+
+    // 40 and 50 would both be played as 127.
+    REQUIRE(!transformed.setTransform(NoteTransform::transpose(90)));
+    REQUIRE(!transformed.hasTransform());
+
+    REQUIRE(transformed.setTransform(NoteTransform::transpose(40)));
+  }
+
+  SECTION("appended notes are checked against the notes seen before") {
+    auto piece = [](std::vector<uint8_t> pitches) {
+      Chronology<noteData> c;
+      for (auto pitch : pitches) {
+        c.pushEvent(0, makeNote(true, pitch));
+        c.pushEvent(1, makeNote(false, pitch));
+      }
+      c.finalize();
+      return c;
+    };
+
+    MFPRenderer growing;
+    growing.setPartition(piece({ 40 }));
+    REQUIRE(growing.setTransform(NoteTransform::transpose(90)));
+
+    REQUIRE(growing.appendPartition(piece({ 20 })));
+    REQUIRE(growing.hasTransform());
+
+    // 50 would be played as 127, as 40 is.
+    REQUIRE(!growing.appendPartition(piece({ 50 })));
+    REQUIRE(!growing.hasTransform());
+
+    REQUIRE(growing.setTransform(NoteTransform::transpose(10)));
+    REQUIRE(!growing.setPartition(piece({ 120, 125 })));
+    REQUIRE(!growing.hasTransform());
+  }
+
+  SECTION("channels are told apart as the preprocessing does") {
+    Chronology<noteData> c;
+    c.pushEvent(0, makeNote(true, 60, 100, 1));
+    c.pushEvent(0, makeNote(true, 60, 100, 2));
+    c.pushEvent(1, makeNote(false, 60, 0, 1));
+    c.pushEvent(0, makeNote(false, 60, 0, 2));
+    c.finalize();
+
+    MFPRenderer channels;
+    channels.setPartition(c);
+    REQUIRE(!channels.setTransform(NoteTransform::remapChannel(1, 2)));
+    REQUIRE(channels.setTransform(NoteTransform::remapChannel(1, 15)));
+  }
+}
@@ -0,0 +1,100 @@
+#include <map>
+#include <mutex>
+#include <catch2/catch_test_macros.hpp>
+#include "SessionHost.h"
+#include "./utilities.h"
+
+SCENARIO("hosting several sessions") {
+
+  // SOME VARIABLES USED ACROSS TESTS //////////////////////////////////////////
+
+  const std::vector<noteEvent> score = {
+    { 0, makeNote(true,  60) },
+    { 0, makeNote(true,  64) },
+    { 2, makeNote(false, 60) },
+    { 0, makeNote(false, 64) },
+    { 0, makeNote(true,  62) },
+    { 2, makeNote(false, 62) },
+    { 0, makeNote(true,  67) },
+    { 2, makeNote(false, 67) }
+  };
+
+  const std::vector<commandData> commands = {
+    makeCommand(true,  60, 100),
+    makeCommand(false, 60),
+    makeCommand(true,  61, 80),
+    makeCommand(false, 61),
+    makeCommand(true,  62, 60),
+    makeCommand(false, 62)
+  };
+
+  const controlData pedalDown = { 0xB1, 64, 127 };
+
+  Chronology<noteData> partition;
+  partition.pushSideEvent(0, pedalDown);
+  for (auto& event : score) partition.pushEvent(event.first, event.second);
+  partition.finalize();
+
+  auto shared = std::make_shared<Chronology<noteData> const>(partition);
+
+  // The reference performance, from a standalone renderer.
+
+  MFPRenderer standalone;
+  standalone.setPartition(partition);
+  std::vector<std::vector<noteData>> expected;
+  for (auto& command : commands) expected.push_back(standalone.combine3(command));
+
+  std::mutex resultsMutex;
+  std::map<SessionHost::sessionId, std::vector<std::vector<noteData>>> results;
+  std::map<SessionHost::sessionId, std::vector<controlData>> controls;
+
+  auto output = [&](SessionHost::sessionId id, Events::Set<noteData> const& set) {
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    results[id].push_back(set.events);
+    controls[id].insert(controls[id].end(), set.side.events.begin(), set.side.events.end());
+  };
+
+  // PERFORMING TESTS //////////////////////////////////////////////////////////
+
+  GIVEN("sessions created from the same partition on several shards") {
+    const SessionHost::sessionId sessionCount = 8;
+
+    {
+      SessionHost host(output, 3);
+      REQUIRE(host.getShardCount() == 3);
+
+      for (SessionHost::sessionId id = 0; id < sessionCount; id++)
+        REQUIRE(host.createSession(id, shared));
+
+      // Interleave the commands of all sessions.
+
+      for (auto& command : commands) {
+        for (SessionHost::sessionId id = 0; id < sessionCount; id++)
+          REQUIRE(host.sendCommand(id, command));
+      }
+
+      for (SessionHost::sessionId id = 0; id < sessionCount; id++)
+        REQUIRE(host.closeSession(id));
+
+      // Commands sent to a closed session are ignored.
+
+      REQUIRE(host.sendCommand(0, commands[0]));
+    } // Queued messages are processed before the host is destroyed.
+
+    THEN("each session performs as a standalone renderer would") {
+      REQUIRE(results.size() == sessionCount);
+      for (auto& session : results) {
+        REQUIRE(performanceResultsAreIdentical(session.second, expected));
+      }
+    }
+
+    THEN("the side events of the partition are passed on") {
+      for (SessionHost::sessionId id = 0; id < sessionCount; id++)
+        REQUIRE(controls[id] == std::vector<controlData>{ pedalDown });
+    }
+
+    THEN("the shared partition is left untouched") {
+      REQUIRE(shared->size() == partition.size());
+    }
+  }
+}
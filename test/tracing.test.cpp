@@ -0,0 +1,113 @@
+#include <sstream>
+#include <thread>
+#include <catch2/catch_test_macros.hpp>
+#include "Tracing.h"
+#include "./utilities.h"
+
+SCENARIO("tracing the stages of the pipeline") {
+  Tracing::setCapacity(4096);
+  Tracing::clear();
+
+  auto names = []() {
+    std::vector<std::string> res;
+    for (auto& e : Tracing::collect()) res.push_back(e.name);
+    return res;
+  };
+
+  GIVEN("tracing disabled") {
+    Tracing::enable(false);
+    { Tracing::Scope scope("disabled"); }
+
+    THEN("nothing is recorded") {
+      REQUIRE(Tracing::collect().empty());
+    }
+  }
+
+  GIVEN("nested scopes") {
+    Tracing::enable();
+    {
+      Tracing::Scope outer("outer", 60);
+      { Tracing::Scope inner("inner"); }
+    }
+    Tracing::enable(false);
+
+    std::vector<Tracing::event> events = Tracing::collect();
+
+    THEN("they are recorded as they end, the inner one within the outer one") {
+      REQUIRE(names() == std::vector<std::string>{ "inner", "outer" });
+      REQUIRE(events[1].begin <= events[0].begin);
+      REQUIRE(events[0].end <= events[1].end);
+      REQUIRE(events[0].value == Tracing::NO_VALUE);
+      REQUIRE(events[1].value == 60);
+    }
+
+    THEN("they are exported as complete events") {
+      std::ostringstream out;
+      Tracing::writeChromeTrace(out);
+      std::string trace = out.str();
+
+      REQUIRE(trace.find("{\"traceEvents\":[") == 0);
+      REQUIRE(trace.find("\"name\":\"outer\"") != std::string::npos);
+      REQUIRE(trace.find("\"ph\":\"X\"") != std::string::npos);
+      REQUIRE(trace.find("\"args\":{\"value\":60}") != std::string::npos);
+    }
+  }
+
+  GIVEN("a thread recording more than its ring holds") {
+    Tracing::setCapacity(4);
+    Tracing::enable();
+
+    std::thread thread([]() {
+      const char* scopes[] = { "1", "2", "3", "4", "5", "6" };
+      for (const char* name : scopes) Tracing::Scope scope(name);
+    });
+    thread.join();
+
+    Tracing::enable(false);
+
+    THEN("only the latest records are kept, after the thread is gone") {
+      REQUIRE(names() == std::vector<std::string>{ "3", "4", "5", "6" });
+    }
+  }
+
+  GIVEN("a registered thread") {
+    Tracing::registerThread();
+    Tracing::ring* registered = &Tracing::threadRing();
+
+    Tracing::enable();
+    { Tracing::Scope scope("before"); }
+    Tracing::clear();
+    { Tracing::Scope scope("after"); }
+    Tracing::enable(false);
+
+    THEN("clearing empties its ring without allocating another one") {
+      REQUIRE(&Tracing::threadRing() == registered);
+      REQUIRE(names() == std::vector<std::string>{ "after" });
+    }
+  }
+
+#ifdef MFP_ENABLE_TRACING
+  GIVEN("a renderer") {
+    MFPRenderer renderer;
+    feedRenderer(renderer, {
+      { 0, makeNote(true,  60) },
+      { 2, makeNote(false, 60) }
+    });
+
+    Tracing::enable();
+    renderer.combine3(makeCommand(true, 64));
+    Tracing::enable(false);
+
+    THEN("each stage of a keystroke is recorded") {
+      std::vector<std::string> recorded = names();
+      REQUIRE(recorded.back() == "MFPRenderer::combine3Set");
+      REQUIRE(std::find(recorded.begin(), recorded.end(), "Renderer::combine3Set")
+              != recorded.end());
+      REQUIRE(Tracing::collect().back().value == 64);
+    }
+  }
+#endif
+
+  Tracing::enable(false);
+  Tracing::clear();
+}
@@ -1,3 +1,52 @@
 #include <catch2/catch_test_macros.hpp>
 #include "MFPRenderer.h"
 #include "./utilities.h"
+
+SCENARIO("retriggering sounding notes with the OnlyStaccato strategy") {
+
+  auto strategy = VoiceStealing::createStrategy(
+    VoiceStealing::StrategyType::OnlyStaccato
+  );
+
+  auto prevent = [&strategy](std::vector<noteData> notes) {
+    strategy->preventVoiceStealing(notes, makeCommand(true, 60));
+    return notes;
+  };
+
+  GIVEN("a note that is not sounding") {
+    THEN("its note on is left untouched") {
+      REQUIRE(prevent({ makeNote(true, 60) }) ==
+              std::vector<noteData>({ makeNote(true, 60) }));
+    }
+  }
+
+  GIVEN("a note that is already sounding") {
+    prevent({ makeNote(true, 60), makeNote(true, 64) });
+
+    THEN("a note off is forced before its note on") {
+      REQUIRE(prevent({ makeNote(true, 62), makeNote(true, 64) }) ==
+              std::vector<noteData>({
+                makeNote(true, 62),
+                makeNote(false, 64, 0),
+                makeNote(true, 64)
+              }));
+    }
+
+    THEN("the same pitch on another channel is not affected") {
+      REQUIRE(prevent({ makeNote(true, 60, 127, 2) }) ==
+              std::vector<noteData>({ makeNote(true, 60, 127, 2) }));
+    }
+
+    THEN("a released note is no longer sounding") {
+      prevent({ makeNote(false, 60) });
+      REQUIRE(prevent({ makeNote(true, 60) }) ==
+              std::vector<noteData>({ makeNote(true, 60) }));
+    }
+
+    THEN("reset forgets every sounding note") {
+      strategy->reset();
+      REQUIRE(prevent({ makeNote(true, 60) }) ==
+              std::vector<noteData>({ makeNote(true, 60) }));
+    }
+  }
+}